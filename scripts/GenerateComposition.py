@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Copyright (c) Jon Thysell <http://jonthysell.com>
+# Licensed under the MIT License.
+
+# Generates src/compositiondata.inc, the tables behind canonical composition in src/composition.cpp, from the Unicode
+# database bundled with Python. Run it again with a newer Python to pick up a newer version of Unicode.
+
+import os
+import sys
+import unicodedata
+
+# Has to match CompositionBlockShift in src/composition.h
+BlockShift = 7
+BlockSize = 1 << BlockShift
+
+# Marks a starter (combining class 0) which can still compose with the starter before it, like Hangul vowels
+ComposingStarter = 255
+
+
+def is_surrogate(cp):
+    return 0xD800 <= cp <= 0xDFFF
+
+
+def main():
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+    output = os.path.join(root, "src", "compositiondata.inc")
+
+    # Every canonical pair which NFC recomposes, which leaves out composition exclusions and singletons. Hangul
+    # syllables have no decomposition in unicodedata, and are composed arithmetically instead.
+    pairs = []
+    for cp in range(0x110000):
+        if is_surrogate(cp):
+            continue
+        decomposition = unicodedata.decomposition(chr(cp))
+        if not decomposition or decomposition.startswith("<"):
+            continue
+        parts = [int(part, 16) for part in decomposition.split()]
+        if len(parts) != 2 or unicodedata.normalize("NFC", chr(parts[0]) + chr(parts[1])) != chr(cp):
+            continue
+        pairs.append((parts[0], parts[1], cp))
+    pairs.sort()
+
+    properties = {}
+    for cp in range(0x110000):
+        if is_surrogate(cp):
+            continue
+        ccc = unicodedata.combining(chr(cp))
+        if ccc != 0:
+            properties[cp] = ccc
+
+    # Hangul vowels (V) and trailing consonants (T) compose with the syllable before them
+    seconds = [second for _, second, _ in pairs] + list(range(0x1161, 0x1176)) + list(range(0x11A8, 0x11C3))
+    for second in seconds:
+        if second not in properties:
+            properties[second] = ComposingStarter
+
+    if min(properties) < 0x300:
+        sys.exit("GetCompositionProperty in src/composition.h assumes nothing below U+0300 composes")
+
+    # Two stages: each block of code points maps to a shared block of properties, and most blocks are all zero
+    last = max(properties)
+    blocks = [bytes(BlockSize)]
+    block_ids = {blocks[0]: 0}
+    index = []
+    for start in range(0, last + 1, BlockSize):
+        block = bytes(properties.get(cp, 0) for cp in range(start, start + BlockSize))
+        if block not in block_ids:
+            block_ids[block] = len(blocks)
+            blocks.append(block)
+        index.append(block_ids[block])
+
+    if len(blocks) > 256:
+        sys.exit("Too many distinct blocks for a uint8_t index")
+
+    lines = []
+    lines.append("// Copyright (c) Jon Thysell <http://jonthysell.com>")
+    lines.append("// Licensed under the MIT License.")
+    lines.append("")
+    lines.append("// Generated by scripts/GenerateComposition.py from Unicode %s, don't edit by hand."
+                 % unicodedata.unidata_version)
+    lines.append("")
+    lines.append("const uint32_t CompositionIndexLength = %d;" % len(index))
+    lines.append("")
+    lines.append("const uint8_t CompositionIndex[%d] = {" % len(index))
+    for i in range(0, len(index), 20):
+        lines.append("    " + ", ".join(str(b) for b in index[i:i + 20]) + ",")
+    lines.append("};")
+    lines.append("")
+    lines.append("const uint8_t CompositionBlocks[%d][%d] = {" % (len(blocks), BlockSize))
+    for block in blocks:
+        lines.append("    {")
+        for i in range(0, BlockSize, 16):
+            lines.append("        " + ", ".join(str(b) for b in block[i:i + 16]) + ",")
+        lines.append("    },")
+    lines.append("};")
+    lines.append("")
+    lines.append("// Sorted by first and then second code point")
+    lines.append("static const CompositionPair CompositionPairs[%d] = {" % len(pairs))
+    for i in range(0, len(pairs), 3):
+        lines.append("    " + " ".join("{0x%04X, 0x%04X, 0x%04X}," % pair for pair in pairs[i:i + 3]))
+    lines.append("};")
+
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
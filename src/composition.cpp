@@ -0,0 +1,52 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+
+#include "composition.h"
+
+namespace AsciiRename
+{
+
+struct CompositionPair
+{
+    uint32_t First;
+    uint32_t Second;
+    uint32_t Composite;
+};
+
+#include "compositiondata.inc"
+
+// Hangul syllables are composed arithmetically, from https://www.unicode.org/versions/Unicode14.0.0/ch03.pdf
+static const uint32_t HangulSBase = 0xAC00;
+static const uint32_t HangulLBase = 0x1100;
+static const uint32_t HangulVBase = 0x1161;
+static const uint32_t HangulTBase = 0x11A7;
+static const uint32_t HangulLCount = 19;
+static const uint32_t HangulVCount = 21;
+static const uint32_t HangulTCount = 28;
+static const uint32_t HangulNCount = HangulVCount * HangulTCount;
+static const uint32_t HangulSCount = HangulLCount * HangulNCount;
+
+uint32_t Compose(uint32_t first, uint32_t second)
+{
+    if (first - HangulLBase < HangulLCount && second - HangulVBase < HangulVCount)
+    {
+        return HangulSBase + ((first - HangulLBase) * HangulVCount + (second - HangulVBase)) * HangulTCount;
+    }
+
+    if (first - HangulSBase < HangulSCount && (first - HangulSBase) % HangulTCount == 0 &&
+        second - HangulTBase - 1 < HangulTCount - 1)
+    {
+        return first + (second - HangulTBase);
+    }
+
+    auto end = CompositionPairs + sizeof(CompositionPairs) / sizeof(CompositionPairs[0]);
+    auto pair = std::lower_bound(CompositionPairs, end, CompositionPair{first, second, 0},
+                                 [](CompositionPair const &a, CompositionPair const &b) {
+                                     return a.First < b.First || (a.First == b.First && a.Second < b.Second);
+                                 });
+    return pair != end && pair->First == first && pair->Second == second ? pair->Composite : 0;
+}
+
+} // namespace AsciiRename
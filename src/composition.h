@@ -0,0 +1,153 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef COMPOSITION_H
+#define COMPOSITION_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace AsciiRename
+{
+
+// No code point has combining class 255, so it marks starters which can compose with the starter before them, like
+// Hangul vowels and trailing consonants
+constexpr uint8_t ComposingStarter = 255;
+
+// Generated into compositiondata.inc by scripts/GenerateComposition.py. Code points map to blocks of properties
+// through the index, with most sharing the all zero block.
+constexpr uint32_t CompositionBlockShift = 7;
+extern const uint32_t CompositionIndexLength;
+extern const uint8_t CompositionIndex[];
+extern const uint8_t CompositionBlocks[][1 << CompositionBlockShift];
+
+// A code point's canonical combining class, or ComposingStarter. Nothing below U+0300 combines with what precedes it.
+inline uint8_t GetCompositionProperty(uint32_t codePoint)
+{
+    uint32_t block = codePoint >> CompositionBlockShift;
+    if (codePoint < 0x300 || block >= CompositionIndexLength)
+    {
+        return 0;
+    }
+    return CompositionBlocks[CompositionIndex[block]][codePoint & ((1u << CompositionBlockShift) - 1)];
+}
+
+// The primary composite of two code points, Hangul syllables included, or zero if they don't compose
+uint32_t Compose(uint32_t first, uint32_t second);
+
+// Canonically composes code points as they're added, so decomposed (NFD) text comes out as its composed (NFC) form
+// without a separate normalization pass. The marks after a starter are put in canonical order as they arrive, and
+// composed with it when the next starter arrives. Finished code points are passed to emit.
+template <typename Emit> class Composer
+{
+  public:
+    explicit Composer(Emit &emit) : m_emit(emit)
+    {
+    }
+
+    void Add(uint32_t codePoint)
+    {
+        uint8_t property = GetCompositionProperty(codePoint);
+        if (property != 0 && property != ComposingStarter)
+        {
+            if (!m_hasStarter || m_markCount == MaxMarks)
+            {
+                // Nothing to compose with, or an absurdly long run of marks
+                Flush();
+                m_emit(codePoint);
+                return;
+            }
+
+            // Insertion keeps the marks sorted by class, and marks of the same class in the order they came
+            size_t i = m_markCount++;
+            for (; i > 0 && m_classes[i - 1] > property; --i)
+            {
+                m_marks[i] = m_marks[i - 1];
+                m_classes[i] = m_classes[i - 1];
+            }
+            m_marks[i] = codePoint;
+            m_classes[i] = property;
+            return;
+        }
+
+        if (m_hasStarter)
+        {
+            ComposeMarks();
+            if (m_markCount == 0 && property == ComposingStarter)
+            {
+                uint32_t composite = Compose(m_starter, codePoint);
+                if (composite != 0)
+                {
+                    m_starter = composite;
+                    return;
+                }
+            }
+            EmitRun();
+        }
+
+        m_hasStarter = true;
+        m_starter = codePoint;
+    }
+
+    // Emits everything held back, to be called at the end of the input
+    void Flush()
+    {
+        if (m_hasStarter)
+        {
+            ComposeMarks();
+            EmitRun();
+            m_hasStarter = false;
+        }
+    }
+
+  private:
+    static constexpr size_t MaxMarks = 32;
+
+    // Composes each mark into the starter unless it's blocked by an earlier mark of the same class which didn't
+    // compose, keeping the rest
+    void ComposeMarks()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < m_markCount; ++i)
+        {
+            uint32_t composite = 0;
+            if (kept == 0 || m_classes[kept - 1] < m_classes[i])
+            {
+                composite = Compose(m_starter, m_marks[i]);
+            }
+
+            if (composite != 0)
+            {
+                m_starter = composite;
+            }
+            else
+            {
+                m_marks[kept] = m_marks[i];
+                m_classes[kept] = m_classes[i];
+                ++kept;
+            }
+        }
+        m_markCount = kept;
+    }
+
+    void EmitRun()
+    {
+        m_emit(m_starter);
+        for (size_t i = 0; i < m_markCount; ++i)
+        {
+            m_emit(m_marks[i]);
+        }
+        m_markCount = 0;
+    }
+
+    Emit &m_emit;
+    bool m_hasStarter = false;
+    uint32_t m_starter = 0;
+    uint32_t m_marks[MaxMarks];
+    uint8_t m_classes[MaxMarks];
+    size_t m_markCount = 0;
+};
+
+} // namespace AsciiRename
+
+#endif
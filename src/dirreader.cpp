@@ -0,0 +1,202 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#endif
+
+#include "dirreader.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+#ifdef _WIN32
+
+DirectoryReader::DirectoryReader() : m_handle(INVALID_HANDLE_VALUE), m_findData(new WIN32_FIND_DATAW), m_pending(false)
+{
+}
+
+DirectoryReader::~DirectoryReader()
+{
+    Close();
+    delete (WIN32_FIND_DATAW *)m_findData;
+}
+
+bool DirectoryReader::Open(const NativeChar *path, std::error_code &ec)
+{
+    Close();
+    auto operation = IoOperation();
+
+    auto pattern = NativeString(path);
+    if (!pattern.empty() && !IsNativeSeparator(pattern.back()))
+    {
+        pattern.push_back(NativeSeparator);
+    }
+    pattern.push_back(L'*');
+
+    m_handle = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, m_findData, FindExSearchNameMatch, nullptr,
+                                FIND_FIRST_EX_LARGE_FETCH);
+    if (m_handle == INVALID_HANDLE_VALUE)
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        return false;
+    }
+
+    m_pending = true;
+    ec.clear();
+    return true;
+}
+
+bool DirectoryReader::Next(DirectoryEntry &entry, std::error_code &ec)
+{
+    auto findData = (WIN32_FIND_DATAW *)m_findData;
+    ec.clear();
+
+    while (m_handle != INVALID_HANDLE_VALUE)
+    {
+        if (!m_pending && !FindNextFileW(m_handle, findData))
+        {
+            if (GetLastError() != ERROR_NO_MORE_FILES)
+            {
+                ec = std::error_code((int)GetLastError(), std::system_category());
+            }
+            return false;
+        }
+        m_pending = false;
+
+        auto name = NativeStringView(findData->cFileName);
+        if (name == L"." || name == L"..")
+        {
+            continue;
+        }
+
+        entry.Name = name;
+        entry.Inode = 0;
+        if (findData->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+        {
+            entry.Type = EntryType::Symlink;
+        }
+        else if (findData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            entry.Type = EntryType::Directory;
+        }
+        else
+        {
+            entry.Type = EntryType::Other;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void DirectoryReader::Close()
+{
+    if (m_handle != INVALID_HANDLE_VALUE)
+    {
+        FindClose(m_handle);
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+#else
+
+DirectoryReader::DirectoryReader() : m_handle(nullptr)
+{
+}
+
+DirectoryReader::~DirectoryReader()
+{
+    Close();
+}
+
+bool DirectoryReader::Open(const NativeChar *path, std::error_code &ec)
+{
+    Close();
+    auto operation = IoOperation();
+
+    m_handle = opendir(path);
+    if (m_handle == nullptr)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    ec.clear();
+    return true;
+}
+
+bool DirectoryReader::Next(DirectoryEntry &entry, std::error_code &ec)
+{
+    ec.clear();
+
+    while (m_handle != nullptr)
+    {
+        errno = 0;
+        auto dirent = readdir((DIR *)m_handle);
+        if (dirent == nullptr)
+        {
+            if (errno != 0)
+            {
+                ec = std::error_code(errno, std::generic_category());
+            }
+            return false;
+        }
+
+        if (dirent->d_name[0] == '.' &&
+            (dirent->d_name[1] == 0 || (dirent->d_name[1] == '.' && dirent->d_name[2] == 0)))
+        {
+            continue;
+        }
+
+        entry.Name = NativeStringView(dirent->d_name);
+        entry.Inode = (uint64_t)dirent->d_ino;
+#ifdef DT_UNKNOWN
+        switch (dirent->d_type)
+        {
+        case DT_DIR:
+            entry.Type = EntryType::Directory;
+            break;
+        case DT_LNK:
+            entry.Type = EntryType::Symlink;
+            break;
+        case DT_UNKNOWN:
+            entry.Type = EntryType::Unknown;
+            break;
+        default:
+            entry.Type = EntryType::Other;
+            break;
+        }
+#else
+        entry.Type = EntryType::Unknown;
+#endif
+        return true;
+    }
+
+    return false;
+}
+
+void DirectoryReader::Close()
+{
+    if (m_handle != nullptr)
+    {
+        closedir((DIR *)m_handle);
+        m_handle = nullptr;
+    }
+}
+
+#endif
+
+} // namespace AsciiRename
@@ -0,0 +1,54 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef DIRREADER_H
+#define DIRREADER_H
+
+#include <cstdint>
+#include <system_error>
+
+#include "nativepath.h"
+
+namespace AsciiRename
+{
+
+enum class EntryType
+{
+    Unknown,
+    Directory,
+    Symlink,
+    Other,
+};
+
+struct DirectoryEntry
+{
+    NativeStringView Name; // Only valid until the next call to Next()
+    EntryType Type;
+    uint64_t Inode; // Zero if not known
+};
+
+// Streams a directory's entries (without "." and "..") straight from the OS, without any per-entry allocations
+class DirectoryReader
+{
+  public:
+    DirectoryReader();
+    ~DirectoryReader();
+
+    bool Open(const NativeChar *path, std::error_code &ec);
+    bool Next(DirectoryEntry &entry, std::error_code &ec);
+    void Close();
+
+  private:
+    DirectoryReader(const DirectoryReader &) = delete;
+    DirectoryReader &operator=(const DirectoryReader &) = delete;
+
+    void *m_handle;
+#ifdef _WIN32
+    void *m_findData;
+    bool m_pending;
+#endif
+};
+
+} // namespace AsciiRename
+
+#endif
@@ -1,22 +1,23 @@
 // Copyright (c) Jon Thysell <http://jonthysell.com>
 // Licensed under the MIT License.
 
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <cstddef>
 #include <cstring>
 #include <stdint.h>
 
 #include <filesystem>
+#include <vector>
 
 #include <anyascii.h>
 #include <libpu8.h>
 #include <utf8.h>
 
+#include "composition.h"
 #include "helpers.h"
 
-#ifndef _WIN32
-#define u8narrow(X) std::string(X)
-#endif
-
 namespace AsciiRename
 {
 
@@ -44,66 +45,496 @@ void TrimTrailingPathSeparator(
     }
 }
 
-bool TryGetUtf8(
+bool TryGetUtf8(NativeStringView input, std::string &output)
+{
 #ifdef _WIN32
-    std::wstring const &input,
+    output.clear();
+    if (input.empty())
+    {
+        return true;
+    }
+
+    int length = WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, input.data(), (int)input.size(), nullptr, 0,
+                                     nullptr, nullptr);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    output.resize(length);
+    WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, input.data(), (int)input.size(), &output[0], length, nullptr,
+                        nullptr);
 #else
-    std::string const &input,
+    output.assign(input);
 #endif
-    std::string &output)
+    return true;
+}
+
+bool TryGetUtf8View(NativeStringView input, std::string &buffer, std::string_view &output)
 {
-    try
+#ifdef _WIN32
+    if (!TryGetUtf8(input, buffer))
     {
-        output = u8narrow(input);
-        return true;
+        return false;
     }
-    catch (...)
+    output = buffer;
+#else
+    (void)buffer;
+    output = input;
+#endif
+    return true;
+}
+
+// Appends transliterations to the output as-is
+struct RawAppender
+{
+    std::string &Out;
+
+    void Append(const char *s, size_t len)
     {
-        output = nullptr;
-        return false;
+        Out.append(s, len);
+    }
+
+    void Append(char c)
+    {
+        Out.push_back(c);
+    }
+};
+
+// Appends transliterations to the output through a profile's character map, dropping or replacing
+// characters that aren't allowed in a filename as they're written, and keeping track of what's needed to
+// truncate the result later without rescanning it
+struct SanitizingAppender
+{
+    std::string &Out;
+    const char *Map;
+    size_t LastDot = std::string::npos;
+    uint32_t Hash = 2166136261u; // FNV-1a
+
+    void Append(const char *s, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            Append(s[i]);
+        }
+    }
+
+    void Append(char c)
+    {
+        char mapped = Map[(unsigned char)c];
+        if (mapped != 0)
+        {
+            if (mapped == '.')
+            {
+                LastDot = Out.size();
+            }
+            Hash = (Hash ^ (unsigned char)mapped) * 16777619u;
+            Out.push_back(mapped);
+        }
+    }
+};
+
+// The length of the run of ASCII at the start of in, checked a word at a time
+static size_t AsciiPrefixLength(std::string_view in)
+{
+    const uint64_t highBits = 0x8080808080808080ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= in.size(); i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, in.data() + i, sizeof(word));
+        if ((word & highBits) != 0)
+        {
+            break;
+        }
+    }
+    while (i < in.size() && (unsigned char)in[i] < 0x80)
+    {
+        ++i;
+    }
+    return i;
+}
+
+// Adapted from https://github.com/anyascii/anyascii/blob/0.3.1/impl/c/test.c, with canonical composition fused in so
+// decomposed names (as macOS writes them) come out the same as composed ones
+template <typename Appender> static void anyascii_string(std::string_view in, Appender &out)
+{
+    auto emit = [&out](uint32_t codePoint) {
+        if (codePoint < 0x80)
+        {
+            out.Append((char)codePoint);
+            return;
+        }
+        const char *r;
+        size_t rlen = anyascii(codePoint, &r);
+        out.Append(r, rlen);
+    };
+    auto composer = Composer<decltype(emit)>(emit);
+
+    uint32_t utf32;
+    uint32_t state = 0;
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        if (state == UTF8_ACCEPT)
+        {
+            // ASCII maps to itself, so whole runs of it are appended at once, except for the last character, which
+            // could still take a combining mark
+            size_t run = AsciiPrefixLength(in.substr(i));
+            if (run > 0)
+            {
+                composer.Flush();
+                out.Append(in.data() + i, run - 1);
+                composer.Add((unsigned char)in[i + run - 1]);
+                i += run;
+                if (i == in.size())
+                {
+                    break;
+                }
+            }
+        }
+
+        unsigned char c = in[i];
+        utf8_decode(&state, &utf32, c);
+        switch (state)
+        {
+        case UTF8_ACCEPT:
+            composer.Add(utf32);
+            break;
+        case UTF8_REJECT:
+            state = UTF8_ACCEPT;
+            break;
+        }
     }
+
+    composer.Flush();
 }
 
-// Adapted from https://github.com/anyascii/anyascii/blob/0.3.1/impl/c/test.c
-static void anyascii_string(const char *in, char *out)
+static TransliterationOverrides const *s_overrides = nullptr;
+
+void SetTransliterationOverrides(TransliterationOverrides const *overrides)
 {
+    s_overrides = overrides != nullptr && !overrides->Empty() ? overrides : nullptr;
+}
+
+// Overrides can span multiple code points, so decode and compose everything up front to be able to look ahead
+template <typename Appender> static void anyascii_string_overrides(std::string_view in, Appender &out)
+{
+    thread_local auto codePoints = std::vector<uint32_t>();
+    codePoints.clear();
+
+    auto emit = [](uint32_t codePoint) { codePoints.push_back(codePoint); };
+    auto composer = Composer<decltype(emit)>(emit);
+
     uint32_t utf32;
     uint32_t state = 0;
-    size_t rlen;
-    for (; *in; in++)
+    for (unsigned char c : in)
     {
-        utf8_decode(&state, &utf32, (unsigned char)*in);
+        utf8_decode(&state, &utf32, c);
         switch (state)
         {
-        case UTF8_ACCEPT:;
-            const char *r;
-            rlen = anyascii(utf32, &r);
-            memcpy(out, r, rlen);
-            out += rlen;
+        case UTF8_ACCEPT:
+            composer.Add(utf32);
             break;
         case UTF8_REJECT:
             state = UTF8_ACCEPT;
             break;
         }
     }
-    *out = 0;
+    composer.Flush();
+
+    const char *r;
+    size_t rlen;
+    for (size_t i = 0; i < codePoints.size();)
+    {
+        size_t matched = s_overrides->Match(codePoints.data() + i, codePoints.size() - i, &r, &rlen);
+        if (matched == 0)
+        {
+            rlen = anyascii(codePoints[i], &r);
+            matched = 1;
+        }
+        out.Append(r, rlen);
+        i += matched;
+    }
+}
+
+template <typename Appender> static void Transliterate(std::string_view in, Appender &out)
+{
+    if (s_overrides != nullptr)
+    {
+        anyascii_string_overrides(in, out);
+    }
+    else
+    {
+        anyascii_string(in, out);
+    }
+}
+
+bool TryGetAscii(std::string_view utf8Input, std::string &output)
+{
+    try
+    {
+        output.clear();
+        auto appender = RawAppender{output};
+        Transliterate(utf8Input, appender);
+        return true;
+    }
+    catch (...)
+    {
+        output.clear();
+        return false;
+    }
+}
+
+struct SanitizeRules
+{
+    char Map[256];
+    bool TrimTrailingDotsAndSpaces;
+    bool EscapeReservedNames;
+};
+
+static SanitizeRules MakeSanitizeRules(SanitizeProfile profile)
+{
+    auto rules = SanitizeRules();
+    for (int c = 0; c < 256; c++)
+    {
+        rules.Map[c] = (char)c;
+    }
+
+    // NUL and '/' are never allowed
+    rules.Map[0] = 0;
+    rules.Map[(unsigned char)'/'] = '_';
+
+    switch (profile)
+    {
+    case SanitizeProfile::Windows:
+    case SanitizeProfile::Smb:
+        for (int c = 1; c < 0x20; c++)
+        {
+            rules.Map[c] = 0;
+        }
+        for (unsigned char c : std::string_view("\\:*?\"<>|"))
+        {
+            rules.Map[c] = '_';
+        }
+        rules.TrimTrailingDotsAndSpaces = true;
+        rules.EscapeReservedNames = true;
+        break;
+    case SanitizeProfile::UrlSafe:
+        for (int c = 1; c < 256; c++)
+        {
+            bool unreserved = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                              c == '-' || c == '.' || c == '_' || c == '~';
+            rules.Map[c] = c < 0x20 ? 0 : unreserved ? (char)c : '_';
+        }
+        break;
+    default:
+        break;
+    }
+
+    return rules;
+}
+
+#ifdef _WIN32
+static SanitizeProfile s_sanitizeProfile = SanitizeProfile::Windows;
+#else
+static SanitizeProfile s_sanitizeProfile = SanitizeProfile::Posix;
+#endif
+static SanitizeRules s_sanitizeRules = MakeSanitizeRules(s_sanitizeProfile);
+
+bool TryParseSanitizeProfile(const char *input, SanitizeProfile &output)
+{
+    auto name = std::string_view(input);
+    if (name == "posix")
+    {
+        output = SanitizeProfile::Posix;
+    }
+    else if (name == "windows")
+    {
+        output = SanitizeProfile::Windows;
+    }
+    else if (name == "smb")
+    {
+        output = SanitizeProfile::Smb;
+    }
+    else if (name == "url-safe")
+    {
+        output = SanitizeProfile::UrlSafe;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void SetSanitizeProfile(SanitizeProfile profile)
+{
+    s_sanitizeProfile = profile;
+    s_sanitizeRules = MakeSanitizeRules(profile);
+}
+
+static bool IsReservedDeviceName(std::string_view name)
+{
+    // CON, PRN, AUX, NUL, COM1-COM9 and LPT1-LPT9, with or without an extension
+    auto stem = name.substr(0, name.find('.'));
+    auto upper = [&stem](size_t i) { return (char)(stem[i] & ~0x20); };
+
+    if (stem.size() == 3)
+    {
+        auto s = std::string{upper(0), upper(1), upper(2)};
+        return s == "CON" || s == "PRN" || s == "AUX" || s == "NUL";
+    }
+
+    if (stem.size() == 4 && stem[3] >= '1' && stem[3] <= '9')
+    {
+        auto s = std::string{upper(0), upper(1), upper(2)};
+        return s == "COM" || s == "LPT";
+    }
+
+    return false;
+}
+
+// Puts "~XXXXXXXX" before the extension (if it's short enough to be one), shortening the stem if needed to fit
+// MaxNameLength. Used to truncate an over-long name with a hash of the full name, so that different long names with
+// the same start don't collide.
+static void TruncateName(std::string &name, size_t lastDot, uint32_t hash)
+{
+    constexpr size_t MaxExtensionLength = 16;
+    constexpr size_t SuffixLength = 9; // ~XXXXXXXX
+
+    size_t extensionLength = 0;
+    if (lastDot != std::string::npos && lastDot > 0 && name.size() - lastDot <= MaxExtensionLength)
+    {
+        extensionLength = name.size() - lastDot;
+    }
+
+    size_t stemLength = std::min(name.size() - extensionLength, MaxNameLength - SuffixLength - extensionLength);
+
+    char suffix[SuffixLength + 1];
+    snprintf(suffix, sizeof(suffix), "~%08x", hash);
+
+    name.replace(stemLength, name.size() - extensionLength - stemLength, suffix, SuffixLength);
+}
+
+void AddHashSuffix(std::string &name, std::string_view hashed)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (char c : hashed)
+    {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    TruncateName(name, name.rfind('.'), hash);
+}
+
+bool TryGetAsciiName(std::string_view utf8Name, std::string &output)
+{
+    bool truncated = false;
+    return TryGetAsciiName(utf8Name, output, truncated);
 }
 
-bool TryGetAscii(std::string const &utf8Input, std::string &output)
+bool TryGetAsciiName(std::string_view utf8Name, std::string &output, bool &truncated)
 {
-    char *buffer = new char[utf8Input.length()];
+    truncated = false;
     try
     {
-        anyascii_string(utf8Input.c_str(), buffer);
-        output = std::string(buffer);
+        output.clear();
+        if (utf8Name == "." || utf8Name == "..")
+        {
+            // Already safe, and renaming them isn't possible anyway
+            output.assign(utf8Name);
+            return true;
+        }
+
+        auto appender = SanitizingAppender{output, s_sanitizeRules.Map};
+        Transliterate(utf8Name, appender);
+
+        // Only the end of the name needs another look, never the whole thing
+        if (s_sanitizeRules.TrimTrailingDotsAndSpaces)
+        {
+            while (!output.empty() && (output.back() == '.' || output.back() == ' '))
+            {
+                output.pop_back();
+            }
+        }
+
+        size_t lastDot = appender.LastDot;
+        if (s_sanitizeRules.EscapeReservedNames && IsReservedDeviceName(output))
+        {
+            output.insert(output.begin(), '_');
+            if (lastDot != std::string::npos)
+            {
+                // The extension moved along with the rest of the name
+                ++lastDot;
+            }
+        }
+
+        if ((output.empty() && !utf8Name.empty()) || output == "." || output == "..")
+        {
+            // Nothing usable is left, or it'd refer to a directory instead
+            output.assign(std::max<size_t>(output.size(), 1), '_');
+        }
+
+        if (output.size() > MaxNameLength)
+        {
+            TruncateName(output, lastDot < output.size() ? lastDot : std::string::npos, appender.Hash);
+            truncated = true;
+        }
+
         return true;
     }
     catch (...)
     {
-        output = nullptr;
-        delete buffer;
+        output.clear();
         return false;
     }
 }
 
+bool TryGetAsciiPath(std::string_view utf8Path, std::string &output)
+{
+    thread_local auto component = std::string();
+
+    output.clear();
+    while (true)
+    {
+        size_t slash = utf8Path.find('/');
+        auto name = utf8Path.substr(0, slash);
+        if (!name.empty())
+        {
+            if (!TryGetAsciiName(name, component))
+            {
+                return false;
+            }
+            output += component;
+        }
+
+        if (slash == std::string_view::npos)
+        {
+            return true;
+        }
+        output += '/';
+        utf8Path.remove_prefix(slash + 1);
+    }
+}
+
+bool TryParseNonNegativeInt(const char *input, int &output)
+{
+    if (input == nullptr || *input == 0)
+    {
+        return false;
+    }
+
+    int value = 0;
+    for (; *input; input++)
+    {
+        if (*input < '0' || *input > '9' || value > (INT_MAX - (*input - '0')) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + (*input - '0');
+    }
+
+    output = value;
+    return true;
+}
+
 } // namespace AsciiRename
@@ -5,6 +5,10 @@
 #define HELPERS_H
 
 #include <string>
+#include <string_view>
+
+#include "nativepath.h"
+#include "overrides.h"
 
 namespace AsciiRename
 {
@@ -17,15 +21,45 @@ void TrimTrailingPathSeparator(
 #endif
 );
 
-bool TryGetUtf8(
-#ifdef _WIN32
-    std::wstring const &input,
-#else
-    std::string const &input,
-#endif
-    std::string &output);
+bool TryGetUtf8(NativeStringView input, std::string &output);
+
+// Gets a UTF-8 view of a native string, which is the input itself on POSIX, or converted into buffer on Windows
+bool TryGetUtf8View(NativeStringView input, std::string &buffer, std::string_view &output);
+
+// Overrides (if any) are checked before anyascii's own transliterations, and must outlive any use of TryGetAscii
+void SetTransliterationOverrides(TransliterationOverrides const *overrides);
+
+// Reuses output's existing capacity, so repeated calls with the same string don't allocate
+bool TryGetAscii(std::string_view utf8Input, std::string &output);
+
+enum class SanitizeProfile
+{
+    Posix,   // No '/' or NUL
+    Windows, // Also none of \:*?"<>| or control characters, no trailing dots or spaces, and no device names
+    Smb,     // Same as Windows, as SMB shares enforce the same rules
+    UrlSafe, // Only letters, digits and -._~
+};
+
+bool TryParseSanitizeProfile(const char *input, SanitizeProfile &output);
+
+// Sets the profile for TryGetAsciiName, which defaults to the current platform's rules
+void SetSanitizeProfile(SanitizeProfile profile);
+
+// The longest filename, in bytes, that the supported file systems allow
+constexpr size_t MaxNameLength = 255;
+
+// Like TryGetAscii, but the result is also made safe to use as a single filename under the current profile, and
+// names longer than MaxNameLength are truncated
+bool TryGetAsciiName(std::string_view utf8Name, std::string &output);
+bool TryGetAsciiName(std::string_view utf8Name, std::string &output, bool &truncated);
+
+// Tells name apart from another it would collide with, by putting "~XXXXXXXX", a hash of hashed, before its extension
+void AddHashSuffix(std::string &name, std::string_view hashed);
+
+// Converts each component of a '/' separated path with TryGetAsciiName, keeping the separators, "." and ".."
+bool TryGetAsciiPath(std::string_view utf8Path, std::string &output);
 
-bool TryGetAscii(std::string const &utf8Input, std::string &output);
+bool TryParseNonNegativeInt(const char *input, int &output);
 
 } // namespace AsciiRename
 
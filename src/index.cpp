@@ -0,0 +1,210 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "index.h"
+#include "nativepath.h"
+
+namespace AsciiRename
+{
+
+static const char IndexMagic[4] = {'A', 'R', 'I', 'X'};
+static const uint32_t IndexVersion = 1;
+
+bool DirectoryIndex::Load(std::filesystem::path const &path)
+{
+    m_records = nullptr;
+    m_recordCount = 0;
+    m_names = nullptr;
+    m_namesSize = 0;
+    m_updates.clear();
+
+    auto ec = std::error_code();
+    if (!std::filesystem::exists(path, ec))
+    {
+        // First run, start with an empty index
+        return true;
+    }
+
+    if (!m_file.Open(path) || m_file.Size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, m_file.Data(), sizeof(Header));
+
+    if (memcmp(header.Magic, IndexMagic, sizeof(IndexMagic)) != 0 || header.Version != IndexVersion ||
+        header.RecordCount > (m_file.Size() - sizeof(Header)) / sizeof(Record) ||
+        header.NamesSize != m_file.Size() - sizeof(Header) - header.RecordCount * sizeof(Record))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    m_records = reinterpret_cast<const Record *>(m_file.Data() + sizeof(Header));
+    m_recordCount = header.RecordCount;
+    m_names = m_file.Data() + sizeof(Header) + header.RecordCount * sizeof(Record);
+    m_namesSize = header.NamesSize;
+    return true;
+}
+
+bool DirectoryIndex::Save(std::filesystem::path const &path)
+{
+    // Merge the existing records with this run's updates, keeping the result sorted
+    auto records = std::vector<Record>();
+    auto names = std::string();
+
+    auto subdirs = std::vector<std::string>();
+    uint64_t i = 0;
+    auto update = m_updates.begin();
+    while (i < m_recordCount || update != m_updates.end())
+    {
+        auto recordKey = i < m_recordCount ? Key(m_records[i].Device, m_records[i].Inode) : Key(UINT64_MAX, UINT64_MAX);
+
+        if (update != m_updates.end() && update->first <= recordKey)
+        {
+            if (update->first == recordKey)
+            {
+                // Existing record was replaced or invalidated
+                i++;
+            }
+
+            if (update->second.Clean)
+            {
+                records.push_back({update->first.first, update->first.second, update->second.MTime,
+                                   update->second.CTime, (uint32_t)names.size(),
+                                   (uint32_t)update->second.Subdirs.size()});
+                for (auto const &subdir : update->second.Subdirs)
+                {
+                    names.append(subdir.c_str(), subdir.size() + 1);
+                }
+            }
+            update++;
+        }
+        else
+        {
+            auto record = m_records[i++];
+            auto info = FileInfo{record.Device, record.Inode, record.MTime, record.CTime, true};
+            if (TryGetSubdirectories(info, subdirs))
+            {
+                record.NamesOffset = (uint32_t)names.size();
+                for (auto const &subdir : subdirs)
+                {
+                    names.append(subdir.c_str(), subdir.size() + 1);
+                }
+                records.push_back(record);
+            }
+        }
+    }
+
+    auto tempPath = std::filesystem::path();
+    auto ec = std::error_code();
+    if (!TryCreateTempFile(path, tempPath, ec))
+    {
+        return false;
+    }
+
+    {
+        auto stream = std::ofstream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!stream)
+        {
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+
+        Header header;
+        memcpy(header.Magic, IndexMagic, sizeof(IndexMagic));
+        header.Version = IndexVersion;
+        header.RecordCount = records.size();
+        header.NamesSize = names.size();
+
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        stream.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Record));
+        stream.write(names.data(), names.size());
+        if (!stream)
+        {
+            stream.close();
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    m_file.Close();
+
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        auto ignored = std::error_code();
+        std::filesystem::remove(tempPath, ignored);
+        return false;
+    }
+    return true;
+}
+
+bool DirectoryIndex::TryGetSubdirectories(FileInfo const &info, std::vector<std::string> &subdirs) const
+{
+    auto key = Key(info.Device, info.Inode);
+
+    auto update = m_updates.find(key);
+    if (update != m_updates.end())
+    {
+        if (!update->second.Clean || update->second.MTime != info.MTime || update->second.CTime != info.CTime)
+        {
+            return false;
+        }
+        subdirs = update->second.Subdirs;
+        return true;
+    }
+
+    auto record = FindRecord(key);
+    if (record == nullptr || record->MTime != info.MTime || record->CTime != info.CTime)
+    {
+        return false;
+    }
+
+    subdirs.clear();
+    const char *name = m_names + record->NamesOffset;
+    const char *end = m_names + m_namesSize;
+    for (uint32_t i = 0; i < record->NamesCount; i++)
+    {
+        auto len = strnlen(name, end - name);
+        if (name + len == end)
+        {
+            // Truncated names table
+            return false;
+        }
+        subdirs.emplace_back(name, len);
+        name += len + 1;
+    }
+
+    return true;
+}
+
+void DirectoryIndex::MarkClean(FileInfo const &info, std::vector<std::string> const &subdirs)
+{
+    m_updates[Key(info.Device, info.Inode)] = {true, info.MTime, info.CTime, subdirs};
+}
+
+void DirectoryIndex::Invalidate(FileInfo const &info)
+{
+    m_updates[Key(info.Device, info.Inode)] = {false, 0, 0, {}};
+}
+
+const DirectoryIndex::Record *DirectoryIndex::FindRecord(Key const &key) const
+{
+    auto end = m_records + m_recordCount;
+    auto record = std::lower_bound(m_records, end, key,
+                                   [](Record const &r, Key const &k) { return Key(r.Device, r.Inode) < k; });
+    if (record == end || record->Device != key.first || record->Inode != key.second ||
+        record->NamesOffset > m_namesSize)
+    {
+        return nullptr;
+    }
+    return record;
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,75 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mappedfile.h"
+#include "metadata.h"
+
+namespace AsciiRename
+{
+
+// Persistent record of directories which were fully processed by a previous run,
+// keyed by device and inode. A directory whose times haven't changed since then
+// doesn't need to be read again, only its subdirectories need to be visited.
+class DirectoryIndex
+{
+  public:
+    bool Load(std::filesystem::path const &path);
+    bool Save(std::filesystem::path const &path);
+
+    bool TryGetSubdirectories(FileInfo const &info, std::vector<std::string> &subdirs) const;
+
+    void MarkClean(FileInfo const &info, std::vector<std::string> const &subdirs);
+    void Invalidate(FileInfo const &info);
+
+  private:
+    struct Header
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint64_t RecordCount;
+        uint64_t NamesSize;
+    };
+
+    struct Record
+    {
+        uint64_t Device;
+        uint64_t Inode;
+        int64_t MTime;
+        int64_t CTime;
+        uint32_t NamesOffset;
+        uint32_t NamesCount;
+    };
+
+    struct Update
+    {
+        bool Clean;
+        int64_t MTime;
+        int64_t CTime;
+        std::vector<std::string> Subdirs;
+    };
+
+    typedef std::pair<uint64_t, uint64_t> Key;
+
+    const Record *FindRecord(Key const &key) const;
+
+    MappedFile m_file;
+    const Record *m_records = nullptr;
+    uint64_t m_recordCount = 0;
+    const char *m_names = nullptr;
+    uint64_t m_namesSize = 0;
+    std::map<Key, Update> m_updates;
+};
+
+} // namespace AsciiRename
+
+#endif
@@ -3,12 +3,22 @@
 
 #include <filesystem>
 #include <iostream>
-#include <list>
 #include <string>
+#include <vector>
 
 #include <libpu8.h>
 
 #include "helpers.h"
+#include "metadata.h"
+#include "mirror.h"
+#include "overrides.h"
+#include "renamer.h"
+#include "server.h"
+#include "tarfilter.h"
+#include "textfilter.h"
+#include "throttle.h"
+#include "watcher.h"
+#include "ziprewriter.h"
 
 #ifndef VERSION_STR
 #define VERSION_STR "0.0.0"
@@ -31,24 +41,54 @@ void ShowVersion()
 void ShowHelp()
 {
     std::cout << "Usage: ascii-rename [options...] [paths...]\n";
-    std::cout << "-h, --help       Show this help and exit\n";
-    std::cout << "-n, --no-op      Show what would happen but don't actually rename path(s)\n";
-    std::cout << "-o, --overwrite  Overwrite existing paths(s)\n";
-    std::cout << "-r, --recursive  Rename files and subdirectories recursively\n";
-    std::cout << "-v, --verbose    Make the output more verbose\n";
-    std::cout << "-V, --version    Show version number and exit\n";
+    std::cout << "    --adaptive-inflight Tune, from the latency of every file system operation, how many may run\n";
+    std::cout << "                        at once (up to --max-inflight); with --recursive this sets how many\n";
+    std::cout << "                        directories are read ahead, while stats and renames stay one at a time\n";
+    std::cout << "    --apply-plan FILE   Rename as planned in FILE by --plan-out, instead of walking path(s)\n";
+    std::cout << "    --case-insensitive  Treat names differing only in case as colliding\n";
+    std::cout << "    --case-sensitive    Treat names differing only in case as different\n";
+    std::cout << "                        (default: detected from each path's file system)\n";
+    std::cout << "    --copy-to DEST      Copy path(s) into DEST with ASCII names instead of renaming them, sharing\n";
+    std::cout << "                        file data with reflinks where the file system supports them\n";
+    std::cout << "-d, --max-depth N       Recurse at most N levels below each path\n";
+    std::cout << "    --fix-symlinks      Point symlinks found in path(s) at the new names of what they linked to\n";
+    std::cout << "    --follow-symlinks   Recurse into symlinked directories, each directory at most once\n";
+    std::cout << "-h, --help              Show this help and exit\n";
+    std::cout << "-i, --incremental FILE  Skip directories unchanged since the last run recorded in FILE\n";
+    std::cout << "    --inode-order       Process each directory's entries in inode order, for faster cold runs\n";
+    std::cout << "                        on HDDs\n";
+    std::cout << "-j, --jobs N            Use N worker threads (default: one per CPU)\n";
+    std::cout << "    --link-to DEST      Like --copy-to, but link to the original files, and on later runs only\n";
+    std::cout << "                        update changed links, never replacing anything it didn't link\n";
+    std::cout << "    --link-type TYPE    Link with hard links (hard, the default) or absolute symlinks (sym)\n";
+    std::cout << "-m, --map-file FILE     Use the transliterations in FILE ahead of the built-in ones\n";
+    std::cout << "    --max-inflight N    Allow at most N file system operations at once\n";
+    std::cout << "    --max-ops-per-sec N Allow at most N file system operations per second, halved by SIGUSR1 and\n";
+    std::cout << "                        doubled by SIGUSR2 while running\n";
+    std::cout << "-n, --no-op             Show what would happen but don't actually rename path(s)\n";
+    std::cout << "    --no-follow         Rename symlinks but don't recurse through them (default)\n";
+    std::cout << "-o, --overwrite         Overwrite existing paths(s)\n";
+    std::cout << "    --plan-out FILE     With --no-op, also write the planned renames to FILE for --apply-plan\n";
+    std::cout << "    --prefetch N        With --recursive, read up to N directories ahead in the background\n";
+    std::cout << "    --prune             With --link-to, remove links made by earlier runs whose originals are gone\n";
+    std::cout << "-r, --recursive         Rename files and subdirectories recursively\n";
+    std::cout << "-s, --serve SOCKET      Serve rename and transliterate requests on a Unix domain socket\n";
+    std::cout << "                        that only its owner can connect to (mode 0600), since any path sent\n";
+    std::cout << "                        to it may be renamed\n";
+    std::cout << "    --sanitize PROFILE  Make new names safe for PROFILE: posix, windows, smb or url-safe\n";
+    std::cout << "                        (default: windows on Windows, posix elsewhere)\n";
+    std::cout << "    --stat-no-sync      Use cached attributes on network file systems instead of revalidating\n";
+    std::cout << "                        (Linux)\n";
+    std::cout << "    --tar               Copy a tar archive from stdin to stdout, with its member names in ASCII\n";
+    std::cout << "    --text              Transliterate the text in path(s), or stdin, to stdout\n";
+    std::cout << "-v, --verbose           Make the output more verbose\n";
+    std::cout << "-V, --version           Show version number and exit\n";
+    std::cout << "-w, --watch             Keep running and rename new entries as they're added to path(s)\n";
+    std::cout << "-x, --one-file-system   Don't recurse into directories on other file systems\n";
+    std::cout << "    --zip               Rename the entries inside the ZIP archive path(s), rewriting them in place\n";
+    std::cout << "    --zip-out FILE      With --zip and a single archive, write the result to FILE instead\n";
 }
 
-struct PathItem
-{
-#ifdef _WIN32
-    std::wstring Path;
-#else
-    std::string Path;
-#endif
-    bool SubsScanned;
-};
-
 int main_utf8(int argc, char **argv)
 {
     if (argc <= 1)
@@ -58,13 +98,22 @@ int main_utf8(int argc, char **argv)
     }
 
     // Process arguments
-    auto pathItems = std::list<PathItem>();
+    auto paths = std::vector<std::filesystem::path::string_type>();
 
     // Options
-    bool noop = false;
-    bool overwrite = false;
-    bool recursive = false;
-    bool verbose = false;
+    auto options = AsciiRename::RenameOptions();
+    bool watch = false;
+    bool tar = false;
+    bool text = false;
+    bool zip = false;
+    const char *socketPath = nullptr;
+    const char *mapFile = nullptr;
+    const char *applyPlan = nullptr;
+    const char *copyTo = nullptr;
+    const char *linkTo = nullptr;
+    const char *zipOut = nullptr;
+    auto linkType = AsciiRename::MirrorMode::HardLink;
+    auto limits = AsciiRename::IoLimits{0, 0, false};
 
     for (int i = 1; i < argc; ++i)
     {
@@ -82,19 +131,241 @@ int main_utf8(int argc, char **argv)
         }
         else if (ArgEquals(arg, "-n", "--no-op"))
         {
-            noop = true;
+            options.NoOp = true;
         }
         else if (ArgEquals(arg, "-o", "--overwrite"))
         {
-            overwrite = true;
+            options.Overwrite = true;
         }
         else if (ArgEquals(arg, "-r", "--recursive"))
         {
-            recursive = true;
+            options.Recursive = true;
         }
         else if (ArgEquals(arg, "-v", "--verbose"))
         {
-            verbose = true;
+            options.Verbose = true;
+        }
+        else if (ArgEquals(arg, "-w", "--watch"))
+        {
+            watch = true;
+        }
+        else if (arg == u8widen("--tar"))
+        {
+            tar = true;
+        }
+        else if (arg == u8widen("--text"))
+        {
+            text = true;
+        }
+        else if (arg == u8widen("--zip"))
+        {
+            zip = true;
+        }
+        else if (ArgEquals(arg, "-x", "--one-file-system"))
+        {
+            options.OneFileSystem = true;
+        }
+        else if (arg == u8widen("--fix-symlinks"))
+        {
+            options.FixSymlinks = true;
+        }
+        else if (arg == u8widen("--prune"))
+        {
+            options.Prune = true;
+        }
+        else if (arg == u8widen("--follow-symlinks"))
+        {
+            options.FollowSymlinks = true;
+        }
+        else if (arg == u8widen("--no-follow"))
+        {
+            options.FollowSymlinks = false;
+        }
+        else if (arg == u8widen("--stat-no-sync"))
+        {
+            AsciiRename::SetMetadataNoSync(true);
+        }
+        else if (arg == u8widen("--inode-order"))
+        {
+            options.InodeOrder = true;
+        }
+        else if (arg == u8widen("--case-insensitive"))
+        {
+            options.Case = AsciiRename::CaseSensitivity::Insensitive;
+        }
+        else if (arg == u8widen("--case-sensitive"))
+        {
+            options.Case = AsciiRename::CaseSensitivity::Sensitive;
+        }
+        else if (ArgEquals(arg, "-d", "--max-depth"))
+        {
+            if (i + 1 >= argc || !AsciiRename::TryParseNonNegativeInt(argv[i + 1], options.MaxDepth))
+            {
+                std::cerr << "ERROR: \"--max-depth\" requires a non-negative number.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            ++i;
+        }
+        else if (ArgEquals(arg, "-j", "--jobs"))
+        {
+            int jobs = 0;
+            if (i + 1 >= argc || !AsciiRename::TryParseNonNegativeInt(argv[i + 1], jobs))
+            {
+                std::cerr << "ERROR: \"--jobs\" requires a non-negative number.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            options.Jobs = (unsigned)jobs;
+            ++i;
+        }
+        else if (arg == u8widen("--max-ops-per-sec") || arg == u8widen("--max-inflight"))
+        {
+            int limit = 0;
+            if (i + 1 >= argc || !AsciiRename::TryParseNonNegativeInt(argv[i + 1], limit))
+            {
+                std::cerr << "ERROR: \"" << argv[i] << "\" requires a non-negative number.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            (arg == u8widen("--max-inflight") ? limits.MaxInflight : limits.OpsPerSecond) = (unsigned)limit;
+            ++i;
+        }
+        else if (arg == u8widen("--adaptive-inflight"))
+        {
+            limits.Adaptive = true;
+        }
+        else if (arg == u8widen("--prefetch"))
+        {
+            int prefetch = 0;
+            if (i + 1 >= argc || !AsciiRename::TryParseNonNegativeInt(argv[i + 1], prefetch))
+            {
+                std::cerr << "ERROR: \"--prefetch\" requires a non-negative number.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            options.Prefetch = (unsigned)prefetch;
+            ++i;
+        }
+        else if (ArgEquals(arg, "-m", "--map-file"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--map-file\" requires a file.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            mapFile = argv[++i];
+        }
+        else if (ArgEquals(arg, "-s", "--serve"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--serve\" requires a socket path.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            socketPath = argv[++i];
+        }
+        else if (arg == u8widen("--sanitize"))
+        {
+            auto profile = AsciiRename::SanitizeProfile();
+            if (i + 1 >= argc || !AsciiRename::TryParseSanitizeProfile(argv[i + 1], profile))
+            {
+                std::cerr << "ERROR: \"--sanitize\" requires one of posix, windows, smb or url-safe.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            AsciiRename::SetSanitizeProfile(profile);
+            ++i;
+        }
+        else if (arg == u8widen("--plan-out"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--plan-out\" requires a file.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            options.PlanOutFile = argv[++i];
+        }
+        else if (arg == u8widen("--apply-plan"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--apply-plan\" requires a file.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            applyPlan = argv[++i];
+        }
+        else if (arg == u8widen("--copy-to"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--copy-to\" requires a directory.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            copyTo = argv[++i];
+        }
+        else if (arg == u8widen("--link-to"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--link-to\" requires a directory.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            linkTo = argv[++i];
+        }
+        else if (arg == u8widen("--link-type") || ArgStartsWith(arg, "--link-type="))
+        {
+            // Takes either "--link-type sym" or "--link-type=sym"
+            auto type = std::string();
+            if (arg != u8widen("--link-type"))
+            {
+                type = argv[i] + std::string("--link-type=").size();
+            }
+            else if (i + 1 < argc)
+            {
+                type = argv[++i];
+            }
+
+            if (type == "hard")
+            {
+                linkType = AsciiRename::MirrorMode::HardLink;
+            }
+            else if (type == "sym")
+            {
+                linkType = AsciiRename::MirrorMode::Symlink;
+            }
+            else
+            {
+                std::cerr << "ERROR: \"--link-type\" requires one of hard or sym.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+        }
+        else if (arg == u8widen("--zip-out"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--zip-out\" requires a file.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            zipOut = argv[++i];
+        }
+        else if (ArgEquals(arg, "-i", "--incremental"))
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "ERROR: \"--incremental\" requires an index file.";
+                std::cerr << " Run with --help for usage info.\n";
+                return -1;
+            }
+            options.IndexFile = argv[++i];
         }
         else if (ArgStartsWith(arg, "-"))
         {
@@ -112,158 +383,190 @@ int main_utf8(int argc, char **argv)
         }
         else
         {
-            pathItems.push_back({arg, false});
+            paths.push_back(arg);
         }
     }
 
-    // Process pathQueue
-    int renames = 0;
-    int skipped = 0;
+    if (options.PlanOutFile != nullptr && !options.NoOp)
+    {
+        std::cerr << "ERROR: \"--plan-out\" requires \"--no-op\".";
+        std::cerr << " Run with --help for usage info.\n";
+        return -1;
+    }
 
-    while (!pathItems.empty())
+    if (copyTo != nullptr && linkTo != nullptr)
     {
-        auto rawItem = pathItems.front();
-        pathItems.pop_front();
+        std::cerr << "ERROR: \"--copy-to\" and \"--link-to\" can't be used together.";
+        std::cerr << " Run with --help for usage info.\n";
+        return -1;
+    }
 
-        AsciiRename::TrimTrailingPathSeparator(rawItem.Path);
+    if (options.Prune && linkTo == nullptr)
+    {
+        std::cerr << "ERROR: \"--prune\" requires \"--link-to\".";
+        std::cerr << " Run with --help for usage info.\n";
+        return -1;
+    }
+
+    AsciiRename::SetIoLimits(limits);
+    if (limits.OpsPerSecond > 0)
+    {
+        AsciiRename::InstallIoLimitSignals();
+    }
 
-        auto originalPathStr = std::string();
-        if (!AsciiRename::TryGetUtf8(rawItem.Path, originalPathStr))
+    auto overrides = AsciiRename::TransliterationOverrides();
+    if (mapFile != nullptr)
+    {
+        auto error = std::string();
+        if (!overrides.Load(u8widen(mapFile), error))
         {
-            std::cerr << "ERROR: Unable convert a path to UTF8, skipping.\n";
-            ++skipped;
-            continue;
+            std::cerr << "ERROR: Unable to load map file \"" << mapFile << "\": " << error << ".\n";
+            return -1;
         }
+        AsciiRename::SetTransliterationOverrides(&overrides);
+    }
 
-        if (verbose)
+    if (socketPath != nullptr)
+    {
+        return AsciiRename::RunServer(options, socketPath);
+    }
+
+    if (tar)
+    {
+        if (!paths.empty())
         {
-            std::cout << "Processing \"" << originalPathStr << "\"...\n";
+            std::cerr << "ERROR: \"--tar\" reads from stdin and doesn't take paths.";
+            std::cerr << " Run with --help for usage info.\n";
+            return -1;
         }
 
-        auto originalPath = std::filesystem::path(rawItem.Path);
-
-        auto asciiPathStr = std::string();
-        if (!AsciiRename::TryGetAscii(originalPathStr, asciiPathStr))
+        auto filter = AsciiRename::TarFilter(options, 0, 1);
+        if (!filter.Run())
         {
-            std::cerr << "ERROR: Unable convert path \"" << originalPathStr << "\" to ASCII, skipping.\n";
-            ++skipped;
-            continue;
+            return -1;
         }
 
-        auto asciiPath = std::filesystem::path(asciiPathStr);
+        if (options.Verbose)
+        {
+            filter.PrintSummary();
+        }
 
-        bool skip = false;
-        bool skipForNow = false;
+        return filter.Skipped();
+    }
 
-        if (!std::filesystem::exists(originalPath))
+    if (text)
+    {
+        auto filter = AsciiRename::TextFilter(options, 1);
+        bool success = paths.empty() ? filter.Run(0) : true;
+        for (auto const &path : paths)
         {
-            std::cerr << "ERROR: \"" << originalPathStr << "\" doesn't exist.\n";
-            skip = true;
+            success = success && filter.Run(path);
         }
-        else
+
+        if (options.Verbose)
         {
-            // Original path exists, get new path
-            auto newPath = originalPath.parent_path() / asciiPath.filename();
+            filter.PrintSummary();
+        }
 
-            auto newPathStr = std::string();
+        return success ? filter.Skipped() : -1;
+    }
 
-            AsciiRename::TryGetUtf8(
-#ifdef _WIN32
-                newPath.wstring(),
-#else
-                newPath.string(),
-#endif
-                newPathStr);
+    if (zipOut != nullptr && (!zip || paths.size() != 1))
+    {
+        std::cerr << "ERROR: \"--zip-out\" requires \"--zip\" and a single archive.";
+        std::cerr << " Run with --help for usage info.\n";
+        return -1;
+    }
 
-            if (std::filesystem::is_directory(originalPath) && recursive && !rawItem.SubsScanned)
-            {
-                // Looking at a directory and recursive is true, so:
-                // 1. Push item itself back onto front of list but with scanning disabled
-                // 2. Push children ahead of parent on the list, so they'll get processed first
+    if (zip)
+    {
+        auto rewriter = AsciiRename::ZipRewriter(options);
+        auto output = zipOut != nullptr ? std::filesystem::path(u8widen(zipOut)) : std::filesystem::path();
+        for (auto const &path : paths)
+        {
+            rewriter.Rewrite(path, output);
+        }
 
-                if (verbose)
-                {
-                    std::cout << "Re-adding \"" << originalPathStr << "\" and children to queue...\n";
-                }
+        if (options.Verbose)
+        {
+            rewriter.PrintSummary();
+        }
 
-                pathItems.push_front({rawItem.Path, true});
+        return rewriter.Skipped();
+    }
 
-                for (const auto &child : std::filesystem::directory_iterator(originalPath))
-                {
-                    pathItems.push_front({
-#ifdef _WIN32
-                        child.path().wstring(),
-#else
-                        child.path().string(),
-#endif
-                        false});
-                }
+    if (watch)
+    {
+        return AsciiRename::RunWatch(options, paths);
+    }
 
-                skipForNow = true;
-            }
-            else if (originalPathStr == newPathStr)
-            {
-                // Path doesn't change with ASCII transliteration
-                if (verbose)
-                {
-                    std::cout << "No need to rename \"" << originalPathStr << "\".\n";
-                }
-                skip = true;
-            }
-            else if (std::filesystem::exists(newPath) && !overwrite)
-            {
-                // New path already exists, but overwrite is false
-                std::cerr << "ERROR: \"" << newPathStr << "\" already exists.\n";
-                std::cerr << "ERROR: Specify --overwrite to overwrite.\n";
-                skip = true;
-            }
-            else
-            {
-                // Just a single path rename
-                if (noop)
-                {
-                    std::cout << "Would have renamed \"" << originalPathStr << "\" to \"" << newPathStr << "\"...\n";
-                    ++renames;
-                }
-                else
-                {
-                    std::cout << "Renaming \"" << originalPathStr << "\" to \"" << newPathStr << "\"...\n";
-                    try
-                    {
-                        std::filesystem::rename(originalPath, newPath);
-                        ++renames;
-                    }
-                    catch (std::filesystem::filesystem_error e)
-                    {
-                        std::cerr << "ERROR: File system error, unable to rename \"" << originalPathStr << "\" to \""
-                                  << newPathStr << "\".\n";
-                        skip = true;
-                    }
-                }
-            }
+    if (copyTo != nullptr || linkTo != nullptr)
+    {
+        auto mirror = copyTo != nullptr ? AsciiRename::Mirror(options, u8widen(copyTo))
+                                        : AsciiRename::Mirror(options, u8widen(linkTo), linkType);
+        for (auto const &path : paths)
+        {
+            mirror.AddPath(path);
         }
 
-        if (skipForNow)
+        mirror.ProcessPaths();
+
+        if (options.Verbose)
         {
-            if (verbose)
-            {
-                std::cout << "Skipping \"" << originalPathStr << "\" for now...\n";
-            }
+            mirror.PrintSummary();
         }
-        else if (skip)
+
+        return mirror.Skipped();
+    }
+
+    auto renamer = AsciiRename::Renamer(options);
+
+    if (applyPlan != nullptr)
+    {
+        auto plan = AsciiRename::RenamePlan();
+        if (!plan.Load(u8widen(applyPlan)))
         {
-            if (verbose)
-            {
-                std::cout << "Skipping \"" << originalPathStr << "\"...\n";
-            }
-            ++skipped;
+            std::cerr << "ERROR: Unable to read plan file \"" << applyPlan << "\".\n";
+            return -1;
         }
+
+        renamer.ApplyPlan(plan);
+
+        if (options.Verbose)
+        {
+            renamer.PrintSummary();
+        }
+
+        return renamer.Skipped();
+    }
+
+    if (!renamer.LoadIndex())
+    {
+        std::cerr << "ERROR: Unable to read index file \"" << options.IndexFile << "\".\n";
+        return -1;
+    }
+
+    for (auto const &path : paths)
+    {
+        renamer.AddPath(path);
+    }
+
+    renamer.ProcessPaths();
+
+    if (!renamer.SaveIndex())
+    {
+        std::cerr << "ERROR: Unable to write index file \"" << options.IndexFile << "\".\n";
+    }
+
+    if (!renamer.SavePlan())
+    {
+        std::cerr << "ERROR: Unable to write plan file \"" << options.PlanOutFile << "\".\n";
     }
 
-    if (verbose)
+    if (options.Verbose)
     {
-        std::cout << "Renamed: " << renames << ", Skipped: " << skipped << ", Total: " << renames + skipped << "\n";
+        renamer.PrintSummary();
     }
 
-    return skipped;
+    return renamer.Skipped();
 }
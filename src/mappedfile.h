@@ -0,0 +1,47 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <filesystem>
+
+namespace AsciiRename
+{
+
+// A read-only memory mapping of an entire file
+class MappedFile
+{
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(std::filesystem::path const &path);
+    void Close();
+
+    const char *Data() const
+    {
+        return m_data;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+  private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+};
+
+} // namespace AsciiRename
+
+#endif
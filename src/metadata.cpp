@@ -0,0 +1,255 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#else
+#include <unistd.h>
+#endif
+#endif
+
+#include <atomic>
+
+#include "metadata.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+static bool s_noSync = false;
+static std::atomic<uint64_t> s_lookups(0);
+static std::atomic<uint64_t> s_noSyncLookups(0);
+
+void SetMetadataNoSync(bool noSync)
+{
+    s_noSync = noSync;
+}
+
+MetadataCounters GetMetadataCounters()
+{
+    return {s_lookups.load(std::memory_order_relaxed), s_noSyncLookups.load(std::memory_order_relaxed)};
+}
+
+static bool TryGetFileInfoUnthrottled(const NativeChar *path, FileInfo &info, std::error_code &ec)
+{
+#ifdef _WIN32
+    auto handle = CreateFileW(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION fileInfo;
+    FILE_BASIC_INFO basicInfo;
+    bool result = GetFileInformationByHandle(handle, &fileInfo) != 0 &&
+                  GetFileInformationByHandleEx(handle, FileBasicInfo, &basicInfo, sizeof(basicInfo)) != 0;
+    if (!result)
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+    }
+    CloseHandle(handle);
+
+    if (result)
+    {
+        ec.clear();
+        info.Device = fileInfo.dwVolumeSerialNumber;
+        info.Inode = ((uint64_t)fileInfo.nFileIndexHigh << 32) | fileInfo.nFileIndexLow;
+        info.MTime = basicInfo.LastWriteTime.QuadPart * 100;
+        info.CTime = basicInfo.ChangeTime.QuadPart * 100;
+        info.IsDirectory = (fileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    return result;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    ec.clear();
+    info.Device = (uint64_t)st.st_dev;
+    info.Inode = (uint64_t)st.st_ino;
+#ifdef __APPLE__
+    info.MTime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+    info.CTime = (int64_t)st.st_ctimespec.tv_sec * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    info.MTime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    info.CTime = (int64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+    info.IsDirectory = S_ISDIR(st.st_mode);
+    return true;
+#endif
+}
+
+bool TryGetFileInfo(const NativeChar *path, FileInfo &info, std::error_code &ec)
+{
+    auto operation = IoOperation();
+    return TryGetFileInfoUnthrottled(path, info, ec);
+}
+
+bool TryGetFileStatus(const NativeChar *path, bool followSymlinks, FileStatus &status, std::error_code &ec)
+{
+    auto operation = IoOperation();
+
+#ifdef _WIN32
+    s_lookups.fetch_add(1, std::memory_order_relaxed);
+
+    auto attributes = GetFileAttributesW(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        return false;
+    }
+
+    ec.clear();
+    status.IsSymlink = !followSymlinks && (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    status.IsDirectory = !status.IsSymlink && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    status.Device = 0;
+    status.Inode = 0;
+
+    if (status.IsDirectory)
+    {
+        // Identity is only needed to walk directories, and takes opening a handle
+        auto info = FileInfo();
+        if (!TryGetFileInfoUnthrottled(path, info, ec))
+        {
+            return false;
+        }
+        status.Device = info.Device;
+        status.Inode = info.Inode;
+    }
+    return true;
+#else
+    s_lookups.fetch_add(1, std::memory_order_relaxed);
+
+#if defined(__linux__) && defined(STATX_TYPE)
+    // Only ask for what's used, and optionally let network file systems answer from their attribute cache
+    static std::atomic<bool> s_statxUnsupported(false);
+    if (!s_statxUnsupported.load(std::memory_order_relaxed))
+    {
+        int flags = AT_NO_AUTOMOUNT | (s_noSync ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT);
+        unsigned int mask = STATX_TYPE | STATX_INO;
+        struct statx stx;
+
+        int result = followSymlinks ? statx(AT_FDCWD, path, flags, mask, &stx) : -1;
+        if (result != 0 && (!followSymlinks || errno == ENOENT))
+        {
+            // A dangling symlink can't be followed, but is still there to be renamed
+            result = statx(AT_FDCWD, path, flags | AT_SYMLINK_NOFOLLOW, mask, &stx);
+        }
+
+        if (result == 0)
+        {
+            if (s_noSync)
+            {
+                s_noSyncLookups.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            ec.clear();
+            status.IsDirectory = S_ISDIR(stx.stx_mode);
+            status.IsSymlink = S_ISLNK(stx.stx_mode);
+            status.Device = (uint64_t)makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            status.Inode = (uint64_t)stx.stx_ino;
+            return true;
+        }
+        else if (errno != ENOSYS)
+        {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+
+        // Kernel is too old, use stat from now on
+        s_statxUnsupported.store(true, std::memory_order_relaxed);
+    }
+#endif
+
+    struct stat st;
+    bool found = followSymlinks && stat(path, &st) == 0;
+
+    // A dangling symlink can't be followed, but is still there to be renamed
+    if (!found && lstat(path, &st) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    ec.clear();
+    status.IsDirectory = S_ISDIR(st.st_mode);
+    status.IsSymlink = S_ISLNK(st.st_mode);
+    status.Device = (uint64_t)st.st_dev;
+    status.Inode = (uint64_t)st.st_ino;
+    return true;
+#endif
+}
+
+bool TryGetCaseInsensitive(const NativeChar *path, bool &caseInsensitive, std::error_code &ec)
+{
+#ifdef _WIN32
+    // NTFS can be case-sensitive per directory, but Windows itself looks names up case-insensitively
+    (void)path;
+    ec.clear();
+    caseInsensitive = true;
+    return true;
+#elif defined(__APPLE__)
+    errno = 0;
+    long result = pathconf(path, _PC_CASE_SENSITIVE);
+    if (result < 0 && errno != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    ec.clear();
+    caseInsensitive = result == 0;
+    return true;
+#elif defined(__linux__)
+    struct statfs st;
+    if (statfs(path, &st) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    ec.clear();
+    switch ((unsigned long)st.f_type)
+    {
+    case 0x4d44:     // FAT
+    case 0x2011bab0: // exFAT
+    case 0x5346544e: // NTFS
+    case 0x517b:     // SMB
+    case 0xff534d42: // CIFS
+    case 0xfe534d42: // SMB2
+        caseInsensitive = true;
+        break;
+    default:
+        caseInsensitive = false;
+        break;
+    }
+    return true;
+#else
+    (void)path;
+    ec.clear();
+    caseInsensitive = false;
+    return true;
+#endif
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,55 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <cstdint>
+#include <system_error>
+
+#include "nativepath.h"
+
+namespace AsciiRename
+{
+
+struct FileInfo
+{
+    uint64_t Device;
+    uint64_t Inode;
+    int64_t MTime; // Last modification time, in nanoseconds
+    int64_t CTime; // Last status change time, in nanoseconds
+    bool IsDirectory;
+};
+
+bool TryGetFileInfo(const NativeChar *path, FileInfo &info, std::error_code &ec);
+
+struct FileStatus
+{
+    bool IsDirectory;
+    bool IsSymlink; // Only when not following symlinks
+    uint64_t Device;
+    uint64_t Inode;
+};
+
+// The type and identity of a path, or with followSymlinks, of what it links to. On Linux this only asks statx for
+// the type and inode, so file systems can skip filling in the rest.
+bool TryGetFileStatus(const NativeChar *path, bool followSymlinks, FileStatus &status, std::error_code &ec);
+
+// Lets TryGetFileStatus use cached attributes instead of revalidating them with the server, on network file
+// systems which support it (AT_STATX_DONT_SYNC on Linux, ignored elsewhere)
+void SetMetadataNoSync(bool noSync);
+
+struct MetadataCounters
+{
+    uint64_t Lookups;       // Calls to TryGetFileStatus
+    uint64_t NoSyncLookups; // Lookups which were allowed to skip revalidation
+};
+
+MetadataCounters GetMetadataCounters();
+
+// Whether the file system holding path treats names that differ only in case as the same
+bool TryGetCaseInsensitive(const NativeChar *path, bool &caseInsensitive, std::error_code &ec);
+
+} // namespace AsciiRename
+
+#endif
@@ -0,0 +1,1222 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "helpers.h"
+#include "mirror.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+enum class CopyMethod
+{
+    Clone,    // Data is shared with the source (reflink), so nothing was copied
+    Kernel,   // Data was copied without passing through user space
+    Buffered, // Data was read into a buffer and written back out
+};
+
+#ifdef _WIN32
+
+static bool TryCopyFileData(const NativeChar *source, const NativeChar *destination, bool overwrite,
+                            CopyMethod &method, uint64_t &bytes, std::error_code &ec)
+{
+    // CopyFileEx clones blocks itself on file systems which support it, like ReFS
+    auto attributes = WIN32_FILE_ATTRIBUTE_DATA();
+    if (!GetFileAttributesExW(source, GetFileExInfoStandard, &attributes) ||
+        !CopyFileExW(source, destination, nullptr, nullptr, nullptr, overwrite ? 0 : COPY_FILE_FAIL_IF_EXISTS))
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        return false;
+    }
+
+    method = CopyMethod::Kernel;
+    bytes = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    return true;
+}
+
+#else
+
+static bool WriteFull(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t result = write(fd, data, length);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        data += result;
+        length -= result;
+    }
+    return true;
+}
+
+// Whether an error means the file system can't do this kind of copy, rather than that the copy went wrong
+static bool IsUnsupported(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTTY ||
+           error == EBADF;
+}
+
+static bool TryCopyData(int in, int out, uint64_t size, CopyMethod &method, uint64_t &bytes)
+{
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0)
+    {
+        method = CopyMethod::Clone;
+        bytes = size;
+        return true;
+    }
+    if (!IsUnsupported(errno))
+    {
+        return false;
+    }
+#endif
+
+    bytes = 0;
+
+#ifdef __linux__
+    // Lets the file system copy server-side or share extents where it can, and otherwise keeps the data in the kernel
+    method = CopyMethod::Kernel;
+    while (true)
+    {
+        ssize_t result = copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result == 0)
+        {
+            return true;
+        }
+        if (result < 0)
+        {
+            if (bytes == 0 && IsUnsupported(errno))
+            {
+                break;
+            }
+            return false;
+        }
+        bytes += result;
+    }
+#endif
+
+    // Both offsets have moved past whatever was copied so far, so this carries on from there
+    method = CopyMethod::Buffered;
+    const size_t BufferSize = 1024 * 1024;
+    static thread_local auto buffer = std::unique_ptr<char[]>(new char[BufferSize]);
+    while (true)
+    {
+        ssize_t result = read(in, buffer.get(), BufferSize);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result == 0)
+        {
+            return true;
+        }
+        if (result < 0 || !WriteFull(out, buffer.get(), result))
+        {
+            return false;
+        }
+        bytes += result;
+    }
+}
+
+static bool TryCopyFileData(const NativeChar *source, const NativeChar *destination, bool overwrite,
+                            CopyMethod &method, uint64_t &bytes, std::error_code &ec)
+{
+    // Non-blocking so a FIFO that slipped past the listing can't hang the copy before it's turned away
+    int in = open(source, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (in < 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(in, &st) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        close(in);
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        ec = std::make_error_code(std::errc::not_supported);
+        close(in);
+        return false;
+    }
+
+    int out = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC | (overwrite ? O_TRUNC : O_EXCL),
+                   (st.st_mode & 0777) | S_IWUSR);
+    if (out < 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        close(in);
+        return false;
+    }
+
+    bool copied = TryCopyData(in, out, (uint64_t)st.st_size, method, bytes);
+
+    // Keep the source's permissions and modification time, like cp --preserve=mode,timestamps
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    if (!copied || fchmod(out, st.st_mode & 07777) != 0 || futimens(out, times) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        close(out);
+        close(in);
+        unlink(destination);
+        return false;
+    }
+
+    close(in);
+    if (close(out) != 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        unlink(destination);
+        return false;
+    }
+
+    return true;
+}
+
+#endif
+
+Mirror::Mirror(RenameOptions const &options, NativeString const &destination, MirrorMode mode)
+    : m_options(options), m_destination(destination), m_mode(mode)
+{
+    TrimTrailingPathSeparator(m_destination);
+}
+
+void Mirror::AddPath(NativeString const &path)
+{
+    m_rootPaths.push_back(path);
+    TrimTrailingPathSeparator(m_rootPaths.back());
+}
+
+std::string_view Mirror::Utf8(NativeStringView path, std::string &buffer)
+{
+    auto result = std::string_view();
+    if (!TryGetUtf8View(path, buffer, result))
+    {
+        return "?";
+    }
+    return result;
+}
+
+void Mirror::RecordError(ErrorOperation operation, std::string_view message, std::error_code const &ec)
+{
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    std::cerr << "ERROR: " << message;
+    if (ec)
+    {
+        std::cerr << ": " << ec.message();
+    }
+    std::cerr << ".\n";
+    ++m_errors;
+    ++m_errorCounts[(size_t)operation];
+    ++m_skipped;
+}
+
+bool Mirror::TryGetDestination(NativeStringView name, NativeString const &directory, NameSet &names,
+                               NativeString &destination, bool &truncated)
+{
+    auto utf8Name = std::string_view();
+    if (!TryGetUtf8View(name, m_nameBuffer, utf8Name) || !TryGetAsciiName(utf8Name, m_asciiName, truncated))
+    {
+        auto buffer = std::string();
+        RecordError(ErrorOperation::Convert,
+                    "Unable to convert a name in \"" + std::string(Utf8(directory, buffer)) + "\" to ASCII, skipping",
+                    std::error_code());
+        return false;
+    }
+
+    // "." and ".." as roots mean their contents go straight into the destination
+    destination.clear();
+    if (m_asciiName != "." && m_asciiName != "..")
+    {
+        AppendNativePath(destination, directory, NativeString());
+        AppendAscii(destination, m_asciiName);
+    }
+    else
+    {
+        destination.assign(directory);
+    }
+
+    // Two names which become the same can't both be copied
+    if (names.Contains(m_asciiName))
+    {
+        auto buffer = std::string();
+        auto destinationStr = std::string(Utf8(destination, buffer));
+        RecordError(ErrorOperation::Collision,
+                    "More than one path would be mirrored to \"" + destinationStr + "\", skipping \"" +
+                        std::string(utf8Name) + "\"",
+                    std::error_code());
+        return false;
+    }
+    names.Add(m_asciiName);
+
+    return true;
+}
+
+void Mirror::ProcessPaths()
+{
+    auto ec = std::error_code();
+    auto destinationStr = std::string(Utf8(m_destination, m_utf8DestinationBuffer));
+
+    if (!m_options.NoOp)
+    {
+        auto operation = IoOperation();
+        std::filesystem::create_directories(m_destination, ec);
+        if (ec)
+        {
+            RecordError(ErrorOperation::Copy, "Unable to create \"" + destinationStr + "\"", ec);
+            return;
+        }
+    }
+
+    auto status = FileStatus();
+    m_haveDestinationId = TryGetFileStatus(m_destination.c_str(), true, status, ec);
+    m_destinationId = {status.Device, status.Inode};
+
+    m_caseInsensitive = m_options.Case == CaseSensitivity::Insensitive;
+    if (m_options.Case == CaseSensitivity::Auto && !TryGetCaseInsensitive(m_destination.c_str(), m_caseInsensitive, ec))
+    {
+        m_caseInsensitive = false;
+    }
+
+    if (m_mode != MirrorMode::Copy)
+    {
+        LoadOwnedLinks();
+    }
+
+    auto rootNames = NameSet(m_caseInsensitive);
+    for (auto const &root : m_rootPaths)
+    {
+        auto item = MirrorItem{root, NativeString(), 0, 0, EntryType::Unknown, false};
+        auto name = SplitNativePath(root).Name;
+        if (name.empty())
+        {
+            // A root directory, whose contents go straight into the destination
+            item.Destination = m_destination;
+        }
+        else if (!TryGetDestination(name, m_destination, rootNames, item.Destination, item.Truncated))
+        {
+            continue;
+        }
+
+        m_items.push_back(std::move(item));
+        while (!m_items.empty())
+        {
+            auto current = std::move(m_items.back());
+            m_items.pop_back();
+            ProcessItem(current);
+        }
+    }
+
+    if (m_pool)
+    {
+        m_pool->Wait();
+    }
+
+    if (m_mode != MirrorMode::Copy && !m_options.NoOp)
+    {
+        SaveOwnedLinks();
+    }
+}
+
+void Mirror::ProcessItem(MirrorItem &item)
+{
+    auto sourceStr = Utf8(item.Source, m_utf8Buffer);
+    auto destinationStr = Utf8(item.Destination, m_utf8DestinationBuffer);
+    m_truncated += item.Truncated ? 1 : 0;
+
+    // What the listing says is enough for anything that won't be walked, which is most entries
+    auto status = FileStatus();
+    auto ec = std::error_code();
+    if (item.Type == EntryType::Other || (item.Type == EntryType::Symlink && !m_options.FollowSymlinks))
+    {
+        status = {false, item.Type == EntryType::Symlink, 0, 0};
+    }
+    else if (!TryGetFileStatus(item.Source.c_str(), m_options.FollowSymlinks, status, ec))
+    {
+        RecordError(ErrorOperation::Stat, "Unable to access \"" + std::string(sourceStr) + "\"", ec);
+        return;
+    }
+
+    if (status.IsDirectory)
+    {
+        CopyDirectory(item, sourceStr, destinationStr, status);
+    }
+    else if (m_mode != MirrorMode::Copy)
+    {
+        // A single path given to link, rather than one found in a directory
+        auto source = SplitNativePath(item.Source);
+        auto destination = SplitNativePath(item.Destination);
+        auto sourceDirectory = source.Directory.empty() ? NativeString(1, '.') : NativeString(source.Directory);
+        auto batch = std::make_shared<LinkBatch>(sourceDirectory, destination.Directory, m_caseInsensitive);
+        batch->Links.push_back({NativeString(source.Name), NativeString(destination.Name)});
+        SubmitLinks(batch);
+    }
+    else if (status.IsSymlink)
+    {
+        CopySymlink(item, sourceStr, destinationStr);
+    }
+    else if (m_options.NoOp)
+    {
+        std::cout << "Would have copied \"" << sourceStr << "\" to \"" << destinationStr << "\"...\n";
+        ++m_files;
+    }
+    else
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Copying \"" << sourceStr << "\" to \"" << destinationStr << "\"...\n";
+        }
+
+        RunOnPool([this, source = std::move(item.Source), destination = std::move(item.Destination)] {
+            CopyRegularFile(source, destination);
+        });
+    }
+}
+
+void Mirror::RunOnPool(std::function<void()> task)
+{
+    if (m_options.Jobs == 1)
+    {
+        task();
+        return;
+    }
+
+    if (!m_pool)
+    {
+        m_pool = std::make_unique<ThreadPool>(m_options.Jobs);
+    }
+    m_pool->Submit(std::move(task));
+}
+
+void Mirror::CopyRegularFile(NativeString const &source, NativeString const &destination)
+{
+    auto method = CopyMethod::Buffered;
+    uint64_t bytes = 0;
+    auto ec = std::error_code();
+
+    auto operation = IoOperation();
+    if (!TryCopyFileData(source.c_str(), destination.c_str(), m_options.Overwrite, method, bytes, ec))
+    {
+        auto buffer = std::string();
+        auto destinationStr = std::string(Utf8(destination, buffer));
+        auto sourceStr = Utf8(source, buffer);
+        if (ec == std::errc::not_supported)
+        {
+            if (m_options.Verbose)
+            {
+                std::lock_guard<std::mutex> lock(m_outputMutex);
+                std::cout << "Skipping \"" << sourceStr << "\", only files, directories and symlinks are copied.\n";
+            }
+            ++m_skipped;
+        }
+        else if (ec == std::errc::file_exists)
+        {
+            RecordError(ErrorOperation::Collision,
+                        "\"" + destinationStr + "\" already exists, specify --overwrite to overwrite",
+                        std::error_code());
+        }
+        else
+        {
+            RecordError(ErrorOperation::Copy,
+                        "Unable to copy \"" + std::string(sourceStr) + "\" to \"" + destinationStr + "\"", ec);
+        }
+        return;
+    }
+
+    ++m_files;
+    switch (method)
+    {
+    case CopyMethod::Clone:
+        ++m_cloned;
+        m_bytesShared += bytes;
+        break;
+    case CopyMethod::Kernel:
+        ++m_kernelCopied;
+        m_bytesCopied += bytes;
+        break;
+    case CopyMethod::Buffered:
+        ++m_bufferCopied;
+        m_bytesCopied += bytes;
+        break;
+    }
+}
+
+void Mirror::CopySymlink(MirrorItem const &item, std::string_view sourceStr, std::string_view destinationStr)
+{
+    if (m_options.NoOp)
+    {
+        std::cout << "Would have copied symlink \"" << sourceStr << "\" to \"" << destinationStr << "\"...\n";
+        ++m_symlinks;
+        return;
+    }
+
+    if (m_options.Verbose)
+    {
+        std::cout << "Copying symlink \"" << sourceStr << "\" to \"" << destinationStr << "\"...\n";
+    }
+
+    // The link's target is copied as it is, so relative links still point at the original names
+    auto ec = std::error_code();
+    auto operation = IoOperation();
+    std::filesystem::copy_symlink(item.Source, item.Destination, ec);
+    if (ec == std::errc::file_exists && m_options.Overwrite && !std::filesystem::is_directory(item.Destination))
+    {
+        std::filesystem::remove(item.Destination, ec);
+        if (!ec)
+        {
+            std::filesystem::copy_symlink(item.Source, item.Destination, ec);
+        }
+    }
+
+    if (ec == std::errc::file_exists)
+    {
+        RecordError(ErrorOperation::Collision,
+                    "\"" + std::string(destinationStr) + "\" already exists, specify --overwrite to overwrite",
+                    std::error_code());
+    }
+    else if (ec)
+    {
+        RecordError(ErrorOperation::Copy,
+                    "Unable to copy symlink \"" + std::string(sourceStr) + "\" to \"" + std::string(destinationStr) +
+                        "\"",
+                    ec);
+    }
+    else
+    {
+        ++m_symlinks;
+    }
+}
+
+void Mirror::CopyDirectory(MirrorItem &item, std::string_view sourceStr, std::string_view destinationStr,
+                           FileStatus const &status)
+{
+    auto ec = std::error_code();
+
+    if (m_haveDestinationId && status.Device == m_destinationId.Device && status.Inode == m_destinationId.Inode)
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Skipping \"" << sourceStr << "\", it's the destination.\n";
+        }
+        return;
+    }
+
+    if (m_options.NoOp)
+    {
+        std::cout << "Would have created \"" << destinationStr << "\"...\n";
+    }
+    else
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Creating \"" << destinationStr << "\"...\n";
+        }
+
+        // Created before anything inside it, with the source's attributes, and an existing directory is merged into
+        auto operation = IoOperation();
+        bool created = std::filesystem::create_directory(item.Destination, item.Source, ec);
+        if (!ec && !created && !std::filesystem::is_directory(item.Destination, ec))
+        {
+            ec = std::make_error_code(std::errc::file_exists);
+        }
+
+        if (ec)
+        {
+            RecordError(ErrorOperation::Copy, "Unable to create \"" + std::string(destinationStr) + "\"", ec);
+            return;
+        }
+
+        // A directory the mirror made can be pruned with the links in it, unlike one that was already there
+        auto made = FileStatus();
+        if (m_mode != MirrorMode::Copy && created && TryGetFileStatus(item.Destination.c_str(), false, made, ec))
+        {
+            RecordOwnedLink(item.Destination, made.Device, made.Inode);
+        }
+    }
+    ++m_directories;
+
+    bool descend = m_options.Recursive;
+
+    if (descend && m_options.MaxDepth >= 0 && item.Depth >= m_options.MaxDepth)
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Not recursing into \"" << sourceStr << "\", max depth reached.\n";
+        }
+        descend = false;
+    }
+
+    if (descend && m_options.OneFileSystem)
+    {
+        if (item.Depth == 0)
+        {
+            item.RootDevice = status.Device;
+        }
+        else if (status.Device != item.RootDevice)
+        {
+            if (m_options.Verbose)
+            {
+                std::cout << "Not recursing into \"" << sourceStr << "\", it's on a different file system.\n";
+            }
+            descend = false;
+        }
+    }
+
+    if (descend && !m_visited.insert({status.Device, status.Inode}).second)
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Not recursing into \"" << sourceStr << "\", it was already visited.\n";
+        }
+        descend = false;
+    }
+
+    if (!descend)
+    {
+        return;
+    }
+
+    auto reader = DirectoryReader();
+    auto entry = DirectoryEntry();
+    auto batch = std::make_shared<LinkBatch>(item.Source, item.Destination, m_caseInsensitive);
+    size_t first = m_items.size();
+
+    if (reader.Open(item.Source.c_str(), ec))
+    {
+        while (reader.Next(entry, ec))
+        {
+            auto child = MirrorItem{NativeString(), NativeString(), item.Depth + 1, item.RootDevice, entry.Type, false};
+            if (!TryGetDestination(entry.Name, item.Destination, batch->Names, child.Destination, child.Truncated))
+            {
+                continue;
+            }
+            AppendNativePath(child.Source, item.Source, entry.Name);
+
+            if (m_mode != MirrorMode::Copy && !IsDirectory(child))
+            {
+                // Linked along with the rest of the directory, rather than walked
+                m_truncated += child.Truncated ? 1 : 0;
+                auto linkName = SplitNativePath(child.Destination).Name;
+                batch->Links.push_back({NativeString(entry.Name), NativeString(linkName)});
+                continue;
+            }
+
+            m_items.push_back(std::move(child));
+        }
+    }
+
+    if (ec)
+    {
+        RecordError(ErrorOperation::ReadDirectory, "Unable to read directory \"" + std::string(sourceStr) + "\"", ec);
+    }
+    else
+    {
+        // Only a complete listing says which of the destination's entries are stale
+        batch->Prune = true;
+    }
+
+    if (m_mode != MirrorMode::Copy)
+    {
+        SubmitLinks(batch);
+    }
+
+    // Popped in the order they were listed
+    std::reverse(m_items.begin() + first, m_items.end());
+}
+
+bool Mirror::IsDirectory(MirrorItem const &item)
+{
+    if (item.Type == EntryType::Directory || item.Type == EntryType::Other ||
+        (item.Type == EntryType::Symlink && !m_options.FollowSymlinks))
+    {
+        return item.Type == EntryType::Directory;
+    }
+
+    auto status = FileStatus();
+    auto ec = std::error_code();
+    return TryGetFileStatus(item.Source.c_str(), m_options.FollowSymlinks, status, ec) && status.IsDirectory;
+}
+
+void Mirror::SubmitLinks(std::shared_ptr<LinkBatch> const &batch)
+{
+    if (m_options.NoOp)
+    {
+        auto source = NativeString();
+        auto destination = NativeString();
+        for (auto const &[name, linkName] : batch->Links)
+        {
+            source.clear();
+            destination.clear();
+            AppendNativePath(source, batch->Source, name);
+            AppendNativePath(destination, batch->Destination, linkName);
+            std::cout << "Would have linked \"" << Utf8(source, m_utf8Buffer) << "\" to \""
+                      << Utf8(destination, m_utf8DestinationBuffer) << "\"...\n";
+            ++m_files;
+        }
+
+        if (batch->Prune && m_options.Prune)
+        {
+            auto targetBase = m_mode == MirrorMode::Symlink ? SymlinkTargetBase(*batch) : NativeString();
+            for (auto const &owned : FindStale(*batch, targetBase))
+            {
+                std::cout << "Would have removed \"" << Utf8(owned.back(), m_utf8Buffer) << "\"...\n";
+                ++m_removed;
+            }
+        }
+        return;
+    }
+
+    RunOnPool([this, batch] { LinkEntries(*batch); });
+}
+
+void Mirror::RecordLinkError(LinkBatch const &batch, NativeStringView name, NativeStringView linkName,
+                             std::error_code const &ec)
+{
+    auto source = NativeString();
+    auto destination = NativeString();
+    AppendNativePath(source, batch.Source, name);
+    AppendNativePath(destination, batch.Destination, linkName);
+
+    auto sourceBuffer = std::string();
+    auto destinationBuffer = std::string();
+    RecordError(ErrorOperation::Copy,
+                "Unable to link \"" + std::string(Utf8(source, sourceBuffer)) + "\" to \"" +
+                    std::string(Utf8(destination, destinationBuffer)) + "\"",
+                ec);
+}
+
+void Mirror::RecordRemoved(LinkBatch const &batch, NativeStringView name)
+{
+    ++m_removed;
+    if (m_options.Verbose)
+    {
+        auto path = NativeString();
+        AppendNativePath(path, batch.Destination, name);
+        auto buffer = std::string();
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        std::cout << "Removed stale \"" << Utf8(path, buffer) << "\".\n";
+    }
+}
+
+void Mirror::RecordCollision(LinkBatch const &batch, NativeStringView name, NativeStringView linkName)
+{
+    auto source = NativeString();
+    auto destination = NativeString();
+    AppendNativePath(source, batch.Source, name);
+    AppendNativePath(destination, batch.Destination, linkName);
+
+    auto sourceBuffer = std::string();
+    auto destinationBuffer = std::string();
+    RecordError(ErrorOperation::Collision,
+                "\"" + std::string(Utf8(destination, destinationBuffer)) +
+                    "\" already exists and wasn't linked by ascii-rename, skipping \"" +
+                    std::string(Utf8(source, sourceBuffer)) + "\"",
+                std::error_code());
+}
+
+NativeString Mirror::SymlinkTargetBase(LinkBatch const &batch)
+{
+    auto ec = std::error_code();
+    auto base = std::filesystem::absolute(batch.Source, ec).lexically_normal().native();
+    if (!base.empty() && !IsNativeSeparator(base.back()))
+    {
+        base.push_back(NativeSeparator);
+    }
+    return base;
+}
+
+std::vector<std::vector<NativeString>> Mirror::FindStale(LinkBatch const &batch, NativeStringView targetBase)
+{
+    auto stale = std::vector<std::vector<NativeString>>();
+    auto ec = std::error_code();
+    auto status = FileStatus();
+    auto reader = DirectoryReader();
+    if (!TryGetFileStatus(batch.Destination.c_str(), true, status, ec) || !reader.Open(batch.Destination.c_str(), ec))
+    {
+        return stale;
+    }
+
+    auto entry = DirectoryEntry();
+    auto path = NativeString();
+    auto nameBuffer = std::string();
+    auto owned = std::vector<NativeString>();
+    while (reader.Next(entry, ec))
+    {
+        auto utf8Name = std::string_view();
+        if (TryGetUtf8View(entry.Name, nameBuffer, utf8Name) && batch.Names.Contains(utf8Name))
+        {
+            continue;
+        }
+
+        // Anything else, like files of the user's or the manifest itself, is left alone
+        path.clear();
+        AppendNativePath(path, batch.Destination, entry.Name);
+        owned.clear();
+        if (CollectOwned(path, targetBase, status.Device, owned))
+        {
+            stale.push_back(owned);
+        }
+    }
+    return stale;
+}
+
+bool Mirror::CollectOwned(NativeString const &path, NativeStringView targetBase, uint64_t device,
+                          std::vector<NativeString> &owned)
+{
+    auto ec = std::error_code();
+    auto status = FileStatus();
+    if (!TryGetFileStatus(path.c_str(), false, status, ec) || status.Device != device)
+    {
+        // Gone already, or another file system is mounted there
+        return false;
+    }
+
+    bool recorded = false;
+    {
+        std::lock_guard<std::mutex> lock(m_ownedLinksMutex);
+        auto link = m_ownedLinks.find(ManifestKey(path));
+        recorded = link != m_ownedLinks.end() && link->second == FileId{status.Device, status.Inode};
+    }
+
+    if (status.IsDirectory)
+    {
+        // A directory is owned if everything in it is, and it was either made by the mirror or isn't empty, so an
+        // empty directory of the user's is left alone
+        auto reader = DirectoryReader();
+        auto entry = DirectoryEntry();
+        auto child = NativeString();
+        size_t start = owned.size();
+        if (!reader.Open(path.c_str(), ec))
+        {
+            return false;
+        }
+        while (reader.Next(entry, ec))
+        {
+            child.clear();
+            AppendNativePath(child, path, entry.Name);
+            if (!CollectOwned(child, targetBase, device, owned))
+            {
+                return false;
+            }
+        }
+        if (ec || (!recorded && owned.size() == start))
+        {
+            return false;
+        }
+        owned.push_back(path);
+        return true;
+    }
+
+    if (recorded)
+    {
+        owned.push_back(path);
+        return true;
+    }
+
+    // Symlinks into the source were made by the mirror, even without a manifest saying so
+    if (status.IsSymlink && !targetBase.empty())
+    {
+        auto target = std::filesystem::read_symlink(path, ec).native();
+        if (!ec && target.compare(0, targetBase.size(), targetBase) == 0)
+        {
+            owned.push_back(path);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Mirror::RemoveOwned(std::vector<NativeString> const &owned, std::error_code &ec)
+{
+    for (auto const &path : owned)
+    {
+        if (!std::filesystem::remove(path, ec))
+        {
+            ec = ec ? ec : std::make_error_code(std::errc::no_such_file_or_directory);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_ownedLinksMutex);
+        m_ownedLinks.erase(ManifestKey(path));
+    }
+    ec.clear();
+    return true;
+}
+
+NativeString Mirror::ManifestKey(NativeStringView path) const
+{
+    auto relative = path.substr(std::min(path.size(), m_destination.size()));
+    while (!relative.empty() && IsNativeSeparator(relative.front()))
+    {
+        relative.remove_prefix(1);
+    }
+    return NativeString(relative);
+}
+
+void Mirror::RecordOwnedLink(NativeStringView path, uint64_t device, uint64_t inode)
+{
+    auto key = ManifestKey(path);
+    std::lock_guard<std::mutex> lock(m_ownedLinksMutex);
+    m_ownedLinks[std::move(key)] = {device, inode};
+}
+
+// The manifest holds "<device> <inode> <path>" for each link, each ended by a NUL since paths may hold newlines
+void Mirror::LoadOwnedLinks()
+{
+    auto stream = std::ifstream(std::filesystem::path(m_destination) / LinkManifestName, std::ios::binary);
+    auto data = std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+    for (size_t start = 0, end = 0; start < data.size(); start = end + 1)
+    {
+        end = data.find('\0', start);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+
+        const char *record = data.c_str() + start;
+        char *next = nullptr;
+        auto id = FileId();
+        id.Device = strtoull(record, &next, 10);
+        if (*next != ' ')
+        {
+            continue;
+        }
+        id.Inode = strtoull(next + 1, &next, 10);
+        if (*next != ' ' || next + 1 >= data.c_str() + end)
+        {
+            continue;
+        }
+        m_ownedLinks[std::filesystem::u8path(next + 1).native()] = id;
+    }
+}
+
+void Mirror::SaveOwnedLinks()
+{
+    auto path = std::filesystem::path(m_destination) / LinkManifestName;
+    auto tempPath = std::filesystem::path();
+    auto ec = std::error_code();
+    if (!TryCreateTempFile(path, tempPath, ec))
+    {
+        RecordError(ErrorOperation::Copy, "Unable to save the links made in \"" + path.u8string() + "\"", ec);
+        return;
+    }
+
+    {
+        auto stream = std::ofstream(tempPath, std::ios::binary | std::ios::trunc);
+        auto status = FileStatus();
+        auto entryPath = NativeString();
+        for (auto const &[key, id] : m_ownedLinks)
+        {
+            // Entries removed or replaced by someone else since are dropped, so their inodes can't be mistaken later
+            entryPath.clear();
+            AppendNativePath(entryPath, m_destination, key);
+            auto statusEc = std::error_code();
+            if (!TryGetFileStatus(entryPath.c_str(), false, status, statusEc) ||
+                !(FileId{status.Device, status.Inode} == id))
+            {
+                continue;
+            }
+            stream << id.Device << ' ' << id.Inode << ' ' << std::filesystem::path(key).u8string() << '\0';
+        }
+        if (!stream)
+        {
+            ec = std::make_error_code(std::errc::io_error);
+        }
+    }
+
+    if (!ec)
+    {
+        std::filesystem::rename(tempPath, path, ec);
+    }
+
+    if (ec)
+    {
+        auto ignored = std::error_code();
+        std::filesystem::remove(tempPath, ignored);
+        RecordError(ErrorOperation::Copy, "Unable to save the links made in \"" + path.u8string() + "\"", ec);
+    }
+}
+
+#ifndef _WIN32
+
+// Whether an existing entry in the destination is already the link that would be made
+static bool IsLinkUpToDate(MirrorMode mode, int sourceFd, const char *name, int destinationFd, const char *linkName,
+                           struct stat const &existing, NativeString const &target)
+{
+    if (mode == MirrorMode::HardLink)
+    {
+        struct stat st;
+        return fstatat(sourceFd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_dev == existing.st_dev &&
+               st.st_ino == existing.st_ino;
+    }
+
+    if (!S_ISLNK(existing.st_mode) || (size_t)existing.st_size != target.size())
+    {
+        return false;
+    }
+
+    auto buffer = std::string(target.size() + 1, '\0');
+    ssize_t length = readlinkat(destinationFd, linkName, &buffer[0], buffer.size());
+    return length == (ssize_t)target.size() && buffer.compare(0, length, target) == 0;
+}
+
+void Mirror::LinkEntries(LinkBatch const &batch)
+{
+    // Every link in the directory is made relative to these, so the paths are only resolved once
+    int sourceFd = open(batch.Source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int destinationFd = sourceFd < 0 ? -1 : open(batch.Destination.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (destinationFd < 0)
+    {
+        auto ec = std::error_code(errno, std::generic_category());
+        auto buffer = std::string();
+        auto path = Utf8(sourceFd < 0 ? batch.Source : batch.Destination, buffer);
+        RecordError(ErrorOperation::ReadDirectory, "Unable to open \"" + std::string(path) + "\"", ec);
+        if (sourceFd >= 0)
+        {
+            close(sourceFd);
+        }
+        return;
+    }
+
+    // Symlinks point at the originals by absolute path, so they resolve wherever the mirror is
+    auto ec = std::error_code();
+    auto targetBase = m_mode == MirrorMode::Symlink ? SymlinkTargetBase(batch) : NativeString();
+    auto target = NativeString();
+    auto path = NativeString();
+    auto owned = std::vector<NativeString>();
+
+    for (auto const &[name, linkName] : batch.Links)
+    {
+        target.assign(targetBase).append(name);
+
+        auto operation = IoOperation();
+        bool replacing = false;
+        struct stat existing;
+        if (fstatat(destinationFd, linkName.c_str(), &existing, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            path.clear();
+            AppendNativePath(path, batch.Destination, linkName);
+            if (IsLinkUpToDate(m_mode, sourceFd, name.c_str(), destinationFd, linkName.c_str(), existing, target))
+            {
+                RecordOwnedLink(path, existing.st_dev, existing.st_ino);
+                ++m_unchanged;
+                continue;
+            }
+
+            // Only what an earlier run made is replaced, never anything of the user's that has the link's name
+            owned.clear();
+            if (!CollectOwned(path, targetBase, existing.st_dev, owned))
+            {
+                RecordCollision(batch, name, linkName);
+                continue;
+            }
+
+            if (!RemoveOwned(owned, ec))
+            {
+                RecordLinkError(batch, name, linkName, ec);
+                continue;
+            }
+            replacing = true;
+        }
+
+        int result = m_mode == MirrorMode::HardLink
+                         ? linkat(sourceFd, name.c_str(), destinationFd, linkName.c_str(), 0)
+                         : symlinkat(target.c_str(), destinationFd, linkName.c_str());
+        if (result != 0)
+        {
+            RecordLinkError(batch, name, linkName, std::error_code(errno, std::generic_category()));
+            continue;
+        }
+
+        if (fstatat(destinationFd, linkName.c_str(), &existing, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            path.clear();
+            AppendNativePath(path, batch.Destination, linkName);
+            RecordOwnedLink(path, existing.st_dev, existing.st_ino);
+        }
+
+        ++(replacing ? m_replaced : m_linked);
+    }
+
+    if (batch.Prune && m_options.Prune)
+    {
+        // Whatever an earlier run linked that the source no longer has is gone from the mirror too
+        for (auto const &stale : FindStale(batch, targetBase))
+        {
+            auto operation = IoOperation();
+            if (RemoveOwned(stale, ec))
+            {
+                RecordRemoved(batch, SplitNativePath(stale.back()).Name);
+            }
+        }
+    }
+
+    close(destinationFd);
+    close(sourceFd);
+}
+
+#else
+
+void Mirror::LinkEntries(LinkBatch const &batch)
+{
+    auto ec = std::error_code();
+    auto sourceDirectory = std::filesystem::path(batch.Source);
+    auto destinationDirectory = std::filesystem::path(batch.Destination);
+    auto targetBase = m_mode == MirrorMode::Symlink ? SymlinkTargetBase(batch) : NativeString();
+    auto owned = std::vector<NativeString>();
+    auto status = FileStatus();
+
+    for (auto const &[name, linkName] : batch.Links)
+    {
+        auto source = sourceDirectory / name;
+        auto link = destinationDirectory / linkName;
+        auto target = std::filesystem::path(targetBase + name);
+
+        auto operation = IoOperation();
+        bool replacing = false;
+        auto existing = std::filesystem::symlink_status(link, ec);
+        if (std::filesystem::exists(existing))
+        {
+            bool upToDate = m_mode == MirrorMode::HardLink ? std::filesystem::equivalent(source, link, ec)
+                                                           : std::filesystem::is_symlink(existing) &&
+                                                                 std::filesystem::read_symlink(link, ec) == target;
+            if (upToDate)
+            {
+                if (TryGetFileStatus(link.c_str(), false, status, ec))
+                {
+                    RecordOwnedLink(link.native(), status.Device, status.Inode);
+                }
+                ++m_unchanged;
+                continue;
+            }
+
+            // Only what an earlier run made is replaced, never anything of the user's that has the link's name
+            owned.clear();
+            if (!TryGetFileStatus(link.c_str(), false, status, ec) ||
+                !CollectOwned(link.native(), targetBase, status.Device, owned))
+            {
+                RecordCollision(batch, name, linkName);
+                continue;
+            }
+
+            if (!RemoveOwned(owned, ec))
+            {
+                RecordLinkError(batch, name, linkName, ec);
+                continue;
+            }
+            replacing = true;
+        }
+
+        if (m_mode == MirrorMode::HardLink)
+        {
+            std::filesystem::create_hard_link(source, link, ec);
+        }
+        else
+        {
+            std::filesystem::create_symlink(target, link, ec);
+        }
+
+        if (ec)
+        {
+            RecordLinkError(batch, name, linkName, ec);
+            continue;
+        }
+
+        if (TryGetFileStatus(link.c_str(), false, status, ec))
+        {
+            RecordOwnedLink(link.native(), status.Device, status.Inode);
+        }
+
+        ++(replacing ? m_replaced : m_linked);
+    }
+
+    if (batch.Prune && m_options.Prune)
+    {
+        // Whatever an earlier run linked that the source no longer has is gone from the mirror too
+        for (auto const &stale : FindStale(batch, targetBase))
+        {
+            auto operation = IoOperation();
+            if (RemoveOwned(stale, ec))
+            {
+                RecordRemoved(batch, SplitNativePath(stale.back()).Name);
+            }
+        }
+    }
+}
+
+#endif
+
+void Mirror::PrintSummary() const
+{
+    if (m_mode != MirrorMode::Copy)
+    {
+        std::cout << "Linked: " << m_linked << ", Unchanged: " << m_unchanged << ", Replaced: " << m_replaced
+                  << ", Removed: " << m_removed << ", Directories: " << m_directories << ", Skipped: " << m_skipped
+                  << "\n";
+    }
+    else
+    {
+        std::cout << "Copied: " << m_files << " (Cloned: " << m_cloned << ", In kernel: " << m_kernelCopied
+                  << ", Buffered: " << m_bufferCopied << "), Directories: " << m_directories
+                  << ", Symlinks: " << m_symlinks << ", Skipped: " << m_skipped << "\n";
+        std::cout << "Bytes shared: " << m_bytesShared << ", Bytes copied: " << m_bytesCopied << "\n";
+    }
+
+    if (m_truncated > 0)
+    {
+        std::cout << "Truncated: " << m_truncated << "\n";
+    }
+
+    if (m_errors > 0)
+    {
+        std::cout << "Errors: " << m_errors << " (Convert: " << m_errorCounts[(size_t)ErrorOperation::Convert]
+                  << ", Stat: " << m_errorCounts[(size_t)ErrorOperation::Stat]
+                  << ", Read Directory: " << m_errorCounts[(size_t)ErrorOperation::ReadDirectory]
+                  << ", Collision: " << m_errorCounts[(size_t)ErrorOperation::Collision]
+                  << ", Copy: " << m_errorCounts[(size_t)ErrorOperation::Copy] << ")\n";
+    }
+}
+
+} // namespace AsciiRename
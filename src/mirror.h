@@ -0,0 +1,204 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "dirreader.h"
+#include "metadata.h"
+#include "nameset.h"
+#include "nativepath.h"
+#include "renamer.h"
+#include "threadpool.h"
+
+namespace AsciiRename
+{
+
+enum class MirrorMode
+{
+    Copy,     // Files are copied, sharing their data with reflinks where the file system supports them
+    HardLink, // Files are hard linked, so the destination must be on the same file system
+    Symlink,  // Files are symlinked by absolute path
+};
+
+// Recreates the queued paths (and their children, when recursive) in a destination directory under their ASCII
+// names, leaving the originals untouched. When copying, file data is shared or copied inside the kernel, so it only
+// passes through user space as a last resort. When linking, each directory's links are made together on the pool,
+// and running again only replaces the links that changed, and with Prune, removes the ones whose originals are gone.
+// Only entries the mirror made are ever replaced or removed: links recorded in the destination's LinkManifestName by
+// an earlier run, which are still the same file, and symlinks pointing into the source.
+class Mirror
+{
+  public:
+    Mirror(RenameOptions const &options, NativeString const &destination, MirrorMode mode = MirrorMode::Copy);
+
+    void AddPath(NativeString const &path);
+    void ProcessPaths();
+
+    int Skipped() const
+    {
+        return m_skipped;
+    }
+
+    int Errors() const
+    {
+        return m_errors;
+    }
+
+    void PrintSummary() const;
+
+  private:
+    struct MirrorItem
+    {
+        NativeString Source;
+        NativeString Destination;
+        int Depth;
+        uint64_t RootDevice;
+        EntryType Type; // As listed by the parent directory, if known
+        bool Truncated;
+    };
+
+    // A directory's new names, and when linking, the links to make in its mirror, which are made together
+    struct LinkBatch
+    {
+        LinkBatch(NativeStringView source, NativeStringView destination, bool caseInsensitive)
+            : Source(source), Destination(destination), Names(caseInsensitive)
+        {
+        }
+
+        NativeString Source;
+        NativeString Destination;
+        NameSet Names;                                         // Every ASCII name the directory should hold
+        std::vector<std::pair<NativeString, NativeString>> Links; // Source names and their link names
+        bool Prune = false; // Whether Names is complete, so anything else in the destination is stale
+    };
+
+    // Written into the destination when linking
+    static constexpr const char *LinkManifestName = ".ascii-rename-links";
+
+    void ProcessItem(MirrorItem &item);
+    void CopyDirectory(MirrorItem &item, std::string_view sourceStr, std::string_view destinationStr,
+                       FileStatus const &status);
+    void CopySymlink(MirrorItem const &item, std::string_view sourceStr, std::string_view destinationStr);
+    void CopyRegularFile(NativeString const &source, NativeString const &destination);
+
+    bool IsDirectory(MirrorItem const &item);
+    void SubmitLinks(std::shared_ptr<LinkBatch> const &batch);
+    void LinkEntries(LinkBatch const &batch);
+    void RecordLinkError(LinkBatch const &batch, NativeStringView name, NativeStringView linkName,
+                         std::error_code const &ec);
+    void RecordRemoved(LinkBatch const &batch, NativeStringView name);
+    void RecordCollision(LinkBatch const &batch, NativeStringView name, NativeStringView linkName);
+
+    // The absolute path, ending in a separator, that symlinks to the batch's sources start with
+    NativeString SymlinkTargetBase(LinkBatch const &batch);
+
+    // Entries in the batch's destination which the source no longer has, and which the mirror made
+    std::vector<std::vector<NativeString>> FindStale(LinkBatch const &batch, NativeStringView targetBase);
+
+    // Whether path, and everything under it if it's a directory, was made by the mirror, adding what would have to
+    // be removed to owned, deepest first
+    bool CollectOwned(NativeString const &path, NativeStringView targetBase, uint64_t device,
+                      std::vector<NativeString> &owned);
+    bool RemoveOwned(std::vector<NativeString> const &owned, std::error_code &ec);
+
+    NativeString ManifestKey(NativeStringView path) const;
+    void RecordOwnedLink(NativeStringView path, uint64_t device, uint64_t inode);
+    void LoadOwnedLinks();
+    void SaveOwnedLinks();
+
+    // Runs task on the pool, or right away with a single job
+    void RunOnPool(std::function<void()> task);
+
+    // Works out the destination of name within directory, returning false if it can't be converted or collides
+    bool TryGetDestination(NativeStringView name, NativeString const &directory, NameSet &names,
+                           NativeString &destination, bool &truncated);
+
+    std::string_view Utf8(NativeStringView path, std::string &buffer);
+
+    // Safe to call from the pool
+    void RecordError(ErrorOperation operation, std::string_view message, std::error_code const &ec);
+
+    RenameOptions m_options;
+    NativeString m_destination;
+    MirrorMode m_mode;
+    std::vector<NativeString> m_rootPaths;
+    std::vector<MirrorItem> m_items;
+    bool m_caseInsensitive = false;
+
+    // Scratch buffers reused for every item
+    std::string m_nameBuffer;
+    std::string m_asciiName;
+    std::string m_utf8Buffer;
+    std::string m_utf8DestinationBuffer;
+
+    struct FileId
+    {
+        uint64_t Device;
+        uint64_t Inode;
+
+        bool operator==(FileId const &other) const
+        {
+            return Device == other.Device && Inode == other.Inode;
+        }
+    };
+
+    struct FileIdHash
+    {
+        size_t operator()(FileId const &id) const
+        {
+            return std::hash<uint64_t>()(id.Inode * 0x9e3779b97f4a7c15ull ^ id.Device);
+        }
+    };
+
+    std::unordered_set<FileId, FileIdHash> m_visited;
+
+    // Links made by this run and earlier ones, by their path under the destination, guarded since they're made on the
+    // pool
+    std::unordered_map<NativeString, FileId> m_ownedLinks;
+    std::mutex m_ownedLinksMutex;
+
+    // So a destination inside a source isn't copied into itself
+    FileId m_destinationId = {0, 0};
+    bool m_haveDestinationId = false;
+
+    // Created the first time there's a file to copy, unless running with a single job
+    std::unique_ptr<ThreadPool> m_pool;
+
+    // Updated from the pool
+    std::atomic<int> m_files{0};
+    std::atomic<int> m_cloned{0};
+    std::atomic<int> m_kernelCopied{0};
+    std::atomic<int> m_bufferCopied{0};
+    std::atomic<uint64_t> m_bytesShared{0};
+    std::atomic<uint64_t> m_bytesCopied{0};
+    std::atomic<int> m_linked{0};
+    std::atomic<int> m_unchanged{0};
+    std::atomic<int> m_replaced{0};
+    std::atomic<int> m_removed{0};
+    std::atomic<int> m_skipped{0};
+    std::mutex m_outputMutex;
+    int m_errors = 0;
+    int m_errorCounts[(size_t)ErrorOperation::Count] = {};
+
+    int m_directories = 0;
+    int m_symlinks = 0;
+    int m_truncated = 0;
+};
+
+} // namespace AsciiRename
+
+#endif
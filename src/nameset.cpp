@@ -0,0 +1,205 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "nameset.h"
+
+namespace AsciiRename
+{
+
+// Scratch space for keys, so checking a name doesn't allocate
+static thread_local std::string t_key;
+
+NameSet::NameSet(bool caseInsensitive) : m_caseInsensitive(caseInsensitive)
+{
+}
+
+void NameSet::Reset(bool caseInsensitive)
+{
+    m_caseInsensitive = caseInsensitive;
+
+    if (++m_generation == 0)
+    {
+        // Wrapped around, so old slots could look current again
+        for (auto &shard : m_shards)
+        {
+            for (auto &slot : shard.Slots)
+            {
+                slot.Generation = 0;
+            }
+        }
+        m_generation = 1;
+    }
+
+    for (auto &shard : m_shards)
+    {
+        shard.Keys.clear();
+        shard.Used = 0;
+    }
+}
+
+template <typename Char> bool NameSet::TryMakeKey(std::basic_string_view<Char> name, std::string &key) const
+{
+    key.clear();
+    for (auto c : name)
+    {
+        if ((std::make_unsigned_t<Char>)c >= 0x80)
+        {
+            // Can't match an ASCII name
+            return false;
+        }
+        key.push_back(m_caseInsensitive && c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : (char)c);
+    }
+    return true;
+}
+
+NameSet::Shard &NameSet::ShardFor(size_t hash) const
+{
+    return m_shards[hash % ShardCount];
+}
+
+size_t NameSet::FindSlot(Shard const &shard, std::string const &key, size_t hash) const
+{
+    // The low bits already picked the shard
+    size_t mask = shard.Slots.size() - 1;
+    for (size_t i = (hash / ShardCount) & mask;; i = (i + 1) & mask)
+    {
+        auto const &slot = shard.Slots[i];
+        if (slot.Generation != m_generation ||
+            (slot.Hash == hash && std::string_view(shard.Keys).substr(slot.Offset, slot.Length) == key))
+        {
+            return i;
+        }
+    }
+}
+
+void NameSet::Grow(Shard &shard)
+{
+    auto slots = std::vector<Slot>(std::max<size_t>(16, shard.Slots.size() * 2), Slot{0, 0, 0, 0, 0});
+    slots.swap(shard.Slots);
+
+    size_t mask = shard.Slots.size() - 1;
+    for (auto const &slot : slots)
+    {
+        if (slot.Generation == m_generation)
+        {
+            size_t i = (slot.Hash / ShardCount) & mask;
+            while (shard.Slots[i].Generation == m_generation)
+            {
+                i = (i + 1) & mask;
+            }
+            shard.Slots[i] = slot;
+        }
+    }
+}
+
+void NameSet::AddKey(std::string const &key)
+{
+    size_t hash = std::hash<std::string>()(key);
+    auto &shard = ShardFor(hash);
+    auto lock = std::lock_guard<std::mutex>(shard.Mutex);
+
+    // Kept at most three quarters full, so probes stay short
+    if ((shard.Used + 1) * 4 > shard.Slots.size() * 3)
+    {
+        Grow(shard);
+    }
+
+    auto &slot = shard.Slots[FindSlot(shard, key, hash)];
+    if (slot.Generation == m_generation)
+    {
+        ++slot.Count;
+        return;
+    }
+
+    slot = Slot{hash, shard.Keys.size(), (uint32_t)key.size(), 1, m_generation};
+    shard.Keys.append(key);
+    ++shard.Used;
+}
+
+void NameSet::Add(std::string_view name)
+{
+    if (TryMakeKey(name, t_key))
+    {
+        AddKey(t_key);
+    }
+}
+
+#ifdef _WIN32
+void NameSet::Add(std::wstring_view name)
+{
+    if (TryMakeKey(name, t_key))
+    {
+        AddKey(t_key);
+    }
+}
+#endif
+
+void NameSet::Remove(std::string_view name)
+{
+    if (TryMakeKey(name, t_key))
+    {
+        size_t hash = std::hash<std::string>()(t_key);
+        auto &shard = ShardFor(hash);
+        auto lock = std::lock_guard<std::mutex>(shard.Mutex);
+        if (shard.Slots.empty())
+        {
+            return;
+        }
+
+        // The name stays in its slot even when none are left, which is simpler than moving others back
+        auto &slot = shard.Slots[FindSlot(shard, t_key, hash)];
+        if (slot.Generation == m_generation && slot.Count > 0)
+        {
+            --slot.Count;
+        }
+    }
+}
+
+bool NameSet::Contains(std::string_view asciiName) const
+{
+    if (!TryMakeKey(asciiName, t_key))
+    {
+        return false;
+    }
+
+    size_t hash = std::hash<std::string>()(t_key);
+    auto &shard = ShardFor(hash);
+    auto lock = std::lock_guard<std::mutex>(shard.Mutex);
+    if (shard.Slots.empty())
+    {
+        return false;
+    }
+
+    auto const &slot = shard.Slots[FindSlot(shard, t_key, hash)];
+    return slot.Generation == m_generation && slot.Count > 0;
+}
+
+bool NameSet::Equal(std::string_view a, std::string_view b, bool caseInsensitive)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        char x = a[i];
+        char y = b[i];
+        if (caseInsensitive)
+        {
+            x = x >= 'A' && x <= 'Z' ? (char)(x + ('a' - 'A')) : x;
+            y = y >= 'A' && y <= 'Z' ? (char)(y + ('a' - 'A')) : y;
+        }
+        if (x != y)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,88 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef NAMESET_H
+#define NAMESET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nativepath.h"
+
+namespace AsciiRename
+{
+
+// The names in a directory, for checking new names against without asking the file system. New names are always
+// ASCII, so only ASCII names are kept, and when case-insensitive they're kept with A-Z folded to a-z. Names are
+// spread over shards with their own locks, so a huge directory's names can be added from several threads at once.
+//
+// Each shard keeps its names back to back in one buffer, indexed by an open addressing table, and Reset() keeps
+// both, so a set reused for directory after directory stops allocating once it has held the biggest one.
+class NameSet
+{
+  public:
+    explicit NameSet(bool caseInsensitive = false);
+
+    // Empties the set for another directory, keeping the space it has grown
+    void Reset(bool caseInsensitive);
+
+    void Add(std::string_view name);
+    void Remove(std::string_view name);
+#ifdef _WIN32
+    void Add(std::wstring_view name);
+#endif
+
+    bool Contains(std::string_view asciiName) const;
+
+    bool CaseInsensitive() const
+    {
+        return m_caseInsensitive;
+    }
+
+    // Whether the names would be the same file under the given case sensitivity
+    static bool Equal(std::string_view a, std::string_view b, bool caseInsensitive);
+
+  private:
+    NameSet(const NameSet &) = delete;
+    NameSet &operator=(const NameSet &) = delete;
+
+    static const size_t ShardCount = 16;
+
+    // Slots from before the last reset are empty, so resetting doesn't have to touch them
+    struct Slot
+    {
+        size_t Hash;
+        size_t Offset; // In the shard's Keys
+        uint32_t Length;
+        uint32_t Count; // Zero once every copy of the name is removed
+        uint32_t Generation;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex Mutex;
+        std::string Keys;
+        std::vector<Slot> Slots; // Always a power of two long
+        size_t Used = 0;
+    };
+
+    template <typename Char> bool TryMakeKey(std::basic_string_view<Char> name, std::string &key) const;
+    void AddKey(std::string const &key);
+    Shard &ShardFor(size_t hash) const;
+
+    // The slot holding key, or else the empty slot where it would go
+    size_t FindSlot(Shard const &shard, std::string const &key, size_t hash) const;
+    void Grow(Shard &shard);
+
+    bool m_caseInsensitive;
+    uint32_t m_generation = 1;
+    mutable Shard m_shards[ShardCount];
+};
+
+} // namespace AsciiRename
+
+#endif
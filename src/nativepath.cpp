@@ -0,0 +1,217 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "nativepath.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+bool TryRenameNativePath(const NativeChar *from, const NativeChar *to, bool replace, std::error_code &ec)
+{
+    auto operation = IoOperation();
+
+#ifdef _WIN32
+    if (!MoveFileExW(from, to, replace ? MOVEFILE_REPLACE_EXISTING : 0))
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        return false;
+    }
+#else
+    int result = -1;
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    // Check and rename atomically, so anything created at the new path since it was checked isn't overwritten
+    result = renameat2(AT_FDCWD, from, AT_FDCWD, to, replace ? 0 : RENAME_NOREPLACE);
+    if (result != 0 && errno != EINVAL && errno != ENOSYS)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+#endif
+
+    if (result != 0)
+    {
+        // The file system or kernel can't rename without replacing, so check as close to the rename as possible
+        struct stat status;
+        if (!replace && lstat(to, &status) == 0)
+        {
+            ec = std::make_error_code(std::errc::file_exists);
+            return false;
+        }
+
+        if (rename(from, to) != 0)
+        {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+    }
+#endif
+    ec.clear();
+    return true;
+}
+
+// Unique to this process and call, so neither another run in the same directory nor a leftover from one that crashed
+// is likely to have it, and short enough to fit beside a name of any length
+static std::filesystem::path MakeTempName()
+{
+    static std::atomic<unsigned> s_counter(0);
+    static std::random_device s_random;
+
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+
+    char name[64];
+    snprintf(name, sizeof(name), ".ascii-rename-%lu-%u-%08x.tmp", pid, s_counter++, (unsigned)s_random());
+    return std::filesystem::path(name);
+}
+
+bool TryReplaceSymlink(std::filesystem::path const &link, std::filesystem::path const &target, std::error_code &ec)
+{
+    const int MaxTempAttempts = 16;
+
+    auto operation = IoOperation();
+
+#ifdef _WIN32
+    bool isDirectory = std::filesystem::is_directory(link, ec);
+    auto tempPath = std::filesystem::path();
+    for (int attempt = 0; attempt < MaxTempAttempts; ++attempt)
+    {
+        tempPath = link.parent_path() / MakeTempName();
+        if (isDirectory)
+        {
+            std::filesystem::create_directory_symlink(target, tempPath, ec);
+        }
+        else
+        {
+            std::filesystem::create_symlink(target, tempPath, ec);
+        }
+
+        if (ec != std::errc::file_exists)
+        {
+            break;
+        }
+    }
+
+    if (ec)
+    {
+        return false;
+    }
+
+    if (!MoveFileExW(tempPath.c_str(), link.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        ec = std::error_code((int)GetLastError(), std::system_category());
+        auto ignored = std::error_code();
+        std::filesystem::remove(tempPath, ignored);
+        return false;
+    }
+#else
+    auto directory = link.parent_path();
+    auto name = link.filename();
+    int directoryFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directoryFd < 0)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    // symlinkat fails rather than replace anything already at the temporary name, so another name is tried instead
+    auto tempName = std::filesystem::path();
+    bool replaced = false;
+    for (int attempt = 0; attempt < MaxTempAttempts; ++attempt)
+    {
+        tempName = MakeTempName();
+        replaced = symlinkat(target.c_str(), directoryFd, tempName.c_str()) == 0;
+        if (replaced || errno != EEXIST)
+        {
+            break;
+        }
+    }
+
+    if (replaced && renameat(directoryFd, tempName.c_str(), directoryFd, name.c_str()) != 0)
+    {
+        int error = errno;
+        unlinkat(directoryFd, tempName.c_str(), 0);
+        errno = error;
+        replaced = false;
+    }
+
+    if (!replaced)
+    {
+        ec = std::error_code(errno, std::generic_category());
+        close(directoryFd);
+        return false;
+    }
+    close(directoryFd);
+#endif
+    ec.clear();
+    return true;
+}
+
+bool TryCreateTempFile(std::filesystem::path const &path, std::filesystem::path &tempPath, std::error_code &ec)
+{
+    const int MaxTempAttempts = 16;
+
+    auto operation = IoOperation();
+
+    for (int attempt = 0; attempt < MaxTempAttempts; ++attempt)
+    {
+        tempPath = path.parent_path() / MakeTempName();
+#ifdef _WIN32
+        HANDLE handle =
+            CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(handle);
+            ec.clear();
+            return true;
+        }
+
+        DWORD error = GetLastError();
+        ec = std::error_code((int)error, std::system_category());
+        if (error != ERROR_FILE_EXISTS && error != ERROR_ALREADY_EXISTS)
+        {
+            return false;
+        }
+#else
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd >= 0)
+        {
+            close(fd);
+            ec.clear();
+            return true;
+        }
+
+        ec = std::error_code(errno, std::generic_category());
+        if (errno != EEXIST)
+        {
+            return false;
+        }
+#endif
+    }
+    return false;
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,84 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef NATIVEPATH_H
+#define NATIVEPATH_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace AsciiRename
+{
+
+// Paths in the OS's own encoding, UTF-8 on POSIX and UTF-16 on Windows
+typedef std::filesystem::path::value_type NativeChar;
+typedef std::basic_string<NativeChar> NativeString;
+typedef std::basic_string_view<NativeChar> NativeStringView;
+
+#ifdef _WIN32
+static const NativeChar NativeSeparator = L'\\';
+#else
+static const NativeChar NativeSeparator = '/';
+#endif
+
+inline bool IsNativeSeparator(NativeChar c)
+{
+#ifdef _WIN32
+    return c == L'\\' || c == L'/';
+#else
+    return c == '/';
+#endif
+}
+
+// Views of a path's directory (including its trailing separator, if any) and final component
+struct NativePathParts
+{
+    NativeStringView Directory;
+    NativeStringView Name;
+};
+
+inline NativePathParts SplitNativePath(NativeStringView path)
+{
+    auto i = path.size();
+    while (i > 0 && !IsNativeSeparator(path[i - 1]))
+    {
+        --i;
+    }
+    return {path.substr(0, i), path.substr(i)};
+}
+
+// Appends "directory/name" to output, adding a separator only when needed. The directory may be a view into output
+// itself, so it isn't read again once appending may have moved output's buffer.
+inline void AppendNativePath(NativeString &output, NativeStringView directory, NativeStringView name)
+{
+    bool separator = !directory.empty() && !IsNativeSeparator(directory.back());
+    output.append(directory);
+    if (separator)
+    {
+        output.push_back(NativeSeparator);
+    }
+    output.append(name);
+}
+
+// Appends an ASCII string, which needs no conversion to become native
+inline void AppendAscii(NativeString &output, std::string_view ascii)
+{
+    output.append(ascii.begin(), ascii.end());
+}
+
+// Fails with std::errc::file_exists, rather than replacing, if to already exists and replace is false
+bool TryRenameNativePath(const NativeChar *from, const NativeChar *to, bool replace, std::error_code &ec);
+
+// Points an existing symlink at a new target by creating a new link beside it and renaming it over the old one, so
+// the path is never missing or dangling in between
+bool TryReplaceSymlink(std::filesystem::path const &link, std::filesystem::path const &target, std::error_code &ec);
+
+// Creates a new, empty file beside path with a name nothing else has, for writing path's replacement to before renaming
+// it over path. Never opens an existing file, so neither another run nor a file of the user's is overwritten.
+bool TryCreateTempFile(std::filesystem::path const &path, std::filesystem::path &tempPath, std::error_code &ec);
+
+} // namespace AsciiRename
+
+#endif
@@ -0,0 +1,309 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+
+#include <utf8.h>
+
+#include "composition.h"
+#include "overrides.h"
+
+namespace AsciiRename
+{
+
+static const uint32_t BucketSeed = 0x9e3779b9;
+static const uint32_t MaxDisplacement = 1u << 20;
+
+// Tries before giving up on a table, each with a new seed, as some sets of keys can't be placed with a given one
+static const uint32_t MaxBuildAttempts = 32;
+
+// Names are composed before they're matched, so keys are too, whichever form they were written in
+static void ComposeKey(std::vector<uint32_t> &key)
+{
+    auto composed = std::vector<uint32_t>();
+    auto emit = [&composed](uint32_t codePoint) { composed.push_back(codePoint); };
+    auto composer = Composer<decltype(emit)>(emit);
+    for (auto codePoint : key)
+    {
+        composer.Add(codePoint);
+    }
+    composer.Flush();
+    key.swap(composed);
+}
+
+static bool TryParseKey(std::string const &text, std::vector<uint32_t> &key)
+{
+    key.clear();
+
+    if (text.size() > 2 && text[0] == 'U' && text[1] == '+')
+    {
+        // Code point notation, like "U+0041 U+030A"
+        size_t i = 0;
+        while (i < text.size())
+        {
+            if (text.compare(i, 2, "U+") != 0)
+            {
+                return false;
+            }
+            i += 2;
+
+            uint32_t codePoint = 0;
+            size_t digits = 0;
+            for (; i < text.size() && isxdigit((unsigned char)text[i]) && digits < 6; i++, digits++)
+            {
+                char c = text[i];
+                codePoint = codePoint * 16 + (uint32_t)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+            }
+
+            if (digits == 0 || codePoint > 0x10FFFF)
+            {
+                return false;
+            }
+            key.push_back(codePoint);
+
+            while (i < text.size() && text[i] == ' ')
+            {
+                i++;
+            }
+        }
+        ComposeKey(key);
+        return !key.empty();
+    }
+
+    uint32_t utf32;
+    uint32_t state = 0;
+    for (unsigned char c : text)
+    {
+        utf8_decode(&state, &utf32, c);
+        if (state == UTF8_ACCEPT)
+        {
+            key.push_back(utf32);
+        }
+        else if (state == UTF8_REJECT)
+        {
+            return false;
+        }
+    }
+    ComposeKey(key);
+    return state == UTF8_ACCEPT && !key.empty();
+}
+
+bool TransliterationOverrides::Load(std::filesystem::path const &path, std::string &error)
+{
+    auto stream = std::ifstream(path);
+    if (!stream)
+    {
+        error = "Unable to open file";
+        return false;
+    }
+
+    m_pendingRules.clear();
+
+    auto line = std::string();
+    auto key = std::vector<uint32_t>();
+    for (int lineNumber = 1; std::getline(stream, line); lineNumber++)
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        // Split on the first '=' after the first character, so "==" maps '=' itself
+        auto equals = line.find('=', 1);
+        if (equals == std::string::npos || !TryParseKey(line.substr(0, equals), key))
+        {
+            error = "Invalid rule on line " + std::to_string(lineNumber);
+            return false;
+        }
+
+        auto value = line.substr(equals + 1);
+        if (!std::all_of(value.begin(), value.end(), [](char c) { return (unsigned char)c < 0x80; }))
+        {
+            error = "Replacement isn't ASCII on line " + std::to_string(lineNumber);
+            return false;
+        }
+
+        m_pendingRules.push_back({key, value});
+    }
+
+    if (!Build())
+    {
+        error = "Unable to build a lookup table for the rules";
+        return false;
+    }
+    return true;
+}
+
+bool TransliterationOverrides::Build()
+{
+    // Group rules by first code point, with later duplicates replacing earlier ones
+    auto groups = std::map<uint32_t, std::map<std::vector<uint32_t>, std::string>>();
+    for (auto const &rule : m_pendingRules)
+    {
+        auto rest = std::vector<uint32_t>(rule.Key.begin() + 1, rule.Key.end());
+        groups[rule.Key[0]][rest] = rule.Value;
+    }
+    m_pendingRules.clear();
+
+    m_slots.clear();
+    m_rules.clear();
+    m_keys.clear();
+    m_values.clear();
+    m_displacements.clear();
+
+    if (groups.empty())
+    {
+        return true;
+    }
+
+    auto slots = std::vector<Slot>();
+    for (auto const &group : groups)
+    {
+        auto slot = Slot{group.first, (uint32_t)m_rules.size(), (uint32_t)group.second.size()};
+
+        auto rules =
+            std::vector<std::pair<std::vector<uint32_t>, std::string>>(group.second.begin(), group.second.end());
+        std::stable_sort(rules.begin(), rules.end(),
+                         [](auto const &a, auto const &b) { return a.first.size() > b.first.size(); });
+
+        for (auto const &rule : rules)
+        {
+            m_rules.push_back({(uint32_t)m_keys.size(), (uint32_t)rule.first.size(), (uint32_t)m_values.size(),
+                               (uint32_t)rule.second.size()});
+            m_keys.insert(m_keys.end(), rule.first.begin(), rule.first.end());
+            m_values += rule.second;
+        }
+
+        slots.push_back(slot);
+    }
+
+    // Hash and displace: spread keys into buckets, then find a displacement per bucket (biggest first)
+    // that puts every key in it into a free slot. More buckets and a different spread make that easier,
+    // so retry with both if some bucket can't be placed.
+    auto n = (uint32_t)slots.size();
+    auto bucketCount = std::max<uint32_t>(1, n / 4);
+    auto bucketSeed = BucketSeed;
+    for (uint32_t attempt = 0; attempt < MaxBuildAttempts; attempt++)
+    {
+        if (TryPlaceSlots(slots, bucketCount, bucketSeed))
+        {
+            m_bucketSeed = bucketSeed;
+            return true;
+        }
+        bucketCount = std::min(n, bucketCount * 2);
+        bucketSeed = Hash(bucketSeed, attempt + 1);
+    }
+
+    m_slots.clear();
+    m_displacements.clear();
+    return false;
+}
+
+bool TransliterationOverrides::TryPlaceSlots(std::vector<Slot> const &slots, uint32_t bucketCount, uint32_t bucketSeed)
+{
+    auto n = (uint32_t)slots.size();
+
+    auto buckets = std::vector<std::vector<uint32_t>>(bucketCount);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        buckets[Hash(slots[i].CodePoint, bucketSeed) % bucketCount].push_back(i);
+    }
+
+    auto order = std::vector<uint32_t>(bucketCount);
+    for (uint32_t i = 0; i < bucketCount; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    m_displacements.assign(bucketCount, 0);
+    m_slots.assign(n, Slot{UINT32_MAX, 0, 0});
+
+    auto taken = std::vector<bool>(n, false);
+    auto positions = std::vector<uint32_t>();
+    for (auto b : order)
+    {
+        auto const &bucket = buckets[b];
+        if (bucket.empty())
+        {
+            continue;
+        }
+
+        bool placed = false;
+        for (uint32_t d = 1; d < MaxDisplacement && !placed; d++)
+        {
+            positions.clear();
+            placed = true;
+            for (auto i : bucket)
+            {
+                auto position = Hash(slots[i].CodePoint, d) % n;
+                if (taken[position] || std::find(positions.begin(), positions.end(), position) != positions.end())
+                {
+                    placed = false;
+                    break;
+                }
+                positions.push_back(position);
+            }
+
+            if (placed)
+            {
+                m_displacements[b] = d;
+                for (size_t j = 0; j < bucket.size(); j++)
+                {
+                    taken[positions[j]] = true;
+                    m_slots[positions[j]] = slots[bucket[j]];
+                }
+            }
+        }
+
+        if (!placed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t TransliterationOverrides::Match(const uint32_t *codePoints, size_t count, const char **replacement,
+                                       size_t *replacementLength) const
+{
+    auto n = (uint32_t)m_slots.size();
+    if (n == 0 || count == 0)
+    {
+        return 0;
+    }
+
+    auto displacement = m_displacements[Hash(codePoints[0], m_bucketSeed) % m_displacements.size()];
+    auto const &slot = m_slots[Hash(codePoints[0], displacement) % n];
+    if (slot.CodePoint != codePoints[0])
+    {
+        return 0;
+    }
+
+    for (uint32_t r = slot.RuleOffset; r < slot.RuleOffset + slot.RuleCount; r++)
+    {
+        auto const &rule = m_rules[r];
+        if (rule.KeyLength < count &&
+            std::equal(m_keys.begin() + rule.KeyOffset, m_keys.begin() + rule.KeyOffset + rule.KeyLength,
+                       codePoints + 1))
+        {
+            *replacement = m_values.data() + rule.ValueOffset;
+            *replacementLength = rule.ValueLength;
+            return rule.KeyLength + 1;
+        }
+    }
+
+    return 0;
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,86 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef OVERRIDES_H
+#define OVERRIDES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace AsciiRename
+{
+
+// User-supplied transliterations which take precedence over anyascii's.
+//
+// Each line of a map file is "key=replacement", where key is one or more characters, either literally
+// or as U+XXXX code points separated by spaces. Blank lines and lines starting with # are ignored.
+//
+// Rules are looked up by their first code point through a minimal perfect hash, so checking a code
+// point without an override costs a single probe.
+class TransliterationOverrides
+{
+  public:
+    bool Load(std::filesystem::path const &path, std::string &error);
+
+    bool Empty() const
+    {
+        return m_slots.empty();
+    }
+
+    // Finds the longest rule matching the start of codePoints, returning how many code points it
+    // covers (zero if none) along with its replacement
+    size_t Match(const uint32_t *codePoints, size_t count, const char **replacement, size_t *replacementLength) const;
+
+  private:
+    struct Rule
+    {
+        uint32_t KeyOffset; // Code points after the first, in m_keys
+        uint32_t KeyLength;
+        uint32_t ValueOffset;
+        uint32_t ValueLength;
+    };
+
+    struct Slot
+    {
+        uint32_t CodePoint;
+        uint32_t RuleOffset; // Rules for this first code point, longest key first
+        uint32_t RuleCount;
+    };
+
+    bool AddRule(std::vector<uint32_t> const &key, std::string const &value);
+    bool Build();
+    bool TryPlaceSlots(std::vector<Slot> const &slots, uint32_t bucketCount, uint32_t bucketSeed);
+
+    static uint32_t Hash(uint32_t codePoint, uint32_t seed)
+    {
+        uint32_t h = codePoint ^ seed;
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    struct PendingRule
+    {
+        std::vector<uint32_t> Key;
+        std::string Value;
+    };
+
+    std::vector<PendingRule> m_pendingRules;
+
+    uint32_t m_bucketSeed = 0;
+    std::vector<uint32_t> m_displacements;
+    std::vector<Slot> m_slots;
+    std::vector<Rule> m_rules;
+    std::vector<uint32_t> m_keys;
+    std::string m_values;
+};
+
+} // namespace AsciiRename
+
+#endif
@@ -0,0 +1,144 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <cstring>
+#include <fstream>
+
+#include "plan.h"
+
+namespace AsciiRename
+{
+
+static const char PlanMagic[4] = {'A', 'R', 'P', 'L'};
+static const uint32_t PlanVersion = 2;
+
+uint64_t RenamePlan::AddString(std::string_view s)
+{
+    auto offset = (uint64_t)m_newStrings.size();
+    m_newStrings.append(s);
+    m_newStrings.push_back(0);
+    return offset;
+}
+
+void RenamePlan::Add(std::string_view source, std::string_view target, size_t directoryId, size_t parentId,
+                     uint32_t flags, uint64_t device, uint64_t inode)
+{
+    auto record = Record();
+    auto sourcePath = std::filesystem::u8path(source);
+    if (sourcePath.is_relative())
+    {
+        if (m_currentDirectory.empty())
+        {
+            m_currentDirectory = std::filesystem::current_path();
+        }
+        auto absolute = (m_currentDirectory / sourcePath).u8string();
+        record.SourceOffset = AddString(absolute);
+        record.SourceLength = (uint32_t)absolute.size();
+    }
+    else
+    {
+        record.SourceOffset = AddString(source);
+        record.SourceLength = (uint32_t)source.size();
+    }
+    record.TargetOffset = AddString(target);
+    record.TargetLength = (uint32_t)target.size();
+    record.Parent = NoParent;
+    record.Flags = flags;
+    record.Device = device;
+    record.Inode = inode;
+
+    if (directoryId != 0)
+    {
+        // Children were all added before now, so they can find this entry when saving
+        m_directoryRecords[directoryId] = (uint32_t)m_newRecords.size();
+    }
+
+    m_newRecords.push_back(record);
+    m_newParentIds.push_back(parentId);
+}
+
+bool RenamePlan::Save(std::filesystem::path const &path)
+{
+    for (size_t i = 0; i < m_newRecords.size(); i++)
+    {
+        auto parent = m_directoryRecords.find(m_newParentIds[i]);
+        if (parent != m_directoryRecords.end())
+        {
+            m_newRecords[i].Parent = parent->second;
+        }
+    }
+
+    auto stream = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        return false;
+    }
+
+    Header header;
+    memcpy(header.Magic, PlanMagic, sizeof(PlanMagic));
+    header.Version = PlanVersion;
+    header.RecordCount = m_newRecords.size();
+    header.StringsSize = m_newStrings.size();
+
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    stream.write(reinterpret_cast<const char *>(m_newRecords.data()), m_newRecords.size() * sizeof(Record));
+    stream.write(m_newStrings.data(), m_newStrings.size());
+    return (bool)stream;
+}
+
+bool RenamePlan::Load(std::filesystem::path const &path)
+{
+    m_records = nullptr;
+    m_recordCount = 0;
+    m_strings = nullptr;
+
+    if (!m_file.Open(path) || m_file.Size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, m_file.Data(), sizeof(Header));
+
+    if (memcmp(header.Magic, PlanMagic, sizeof(PlanMagic)) != 0 || header.Version != PlanVersion ||
+        header.RecordCount > (m_file.Size() - sizeof(Header)) / sizeof(Record) ||
+        header.StringsSize != m_file.Size() - sizeof(Header) - header.RecordCount * sizeof(Record))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    auto records = reinterpret_cast<const Record *>(m_file.Data() + sizeof(Header));
+    auto strings = m_file.Data() + sizeof(Header) + header.RecordCount * sizeof(Record);
+
+    // Validate everything up front, so applying never stops halfway through because of a bad plan
+    for (uint64_t i = 0; i < header.RecordCount; i++)
+    {
+        auto const &record = records[i];
+        if (record.SourceOffset >= header.StringsSize ||
+            record.SourceLength >= header.StringsSize - record.SourceOffset ||
+            strings[record.SourceOffset + record.SourceLength] != 0 || record.TargetOffset >= header.StringsSize ||
+            record.TargetLength >= header.StringsSize - record.TargetOffset ||
+            strings[record.TargetOffset + record.TargetLength] != 0 ||
+            (record.Parent != NoParent && (record.Parent <= i || record.Parent >= header.RecordCount)))
+        {
+            m_file.Close();
+            return false;
+        }
+    }
+
+    m_records = records;
+    m_recordCount = header.RecordCount;
+    m_strings = strings;
+    return true;
+}
+
+PlanEntry RenamePlan::Entry(uint64_t index) const
+{
+    auto const &record = m_records[index];
+    return {std::string_view(m_strings + record.SourceOffset, record.SourceLength),
+            std::string_view(m_strings + record.TargetOffset, record.TargetLength), record.Parent, record.Flags,
+            record.Device, record.Inode};
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,97 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mappedfile.h"
+
+namespace AsciiRename
+{
+
+enum PlanFlags : uint32_t
+{
+    PlanDirectory = 1, // Source is a directory
+    PlanTruncated = 2, // Target was truncated to fit MaxNameLength
+};
+
+struct PlanEntry
+{
+    std::string_view Source; // Absolute UTF-8 path, NUL-terminated in the plan
+    std::string_view Target; // New ASCII name for the source's final component
+    uint32_t Parent;         // Entry renaming the source's directory, or NoParent
+    uint32_t Flags;
+    uint64_t Device; // Identity of the source when planned, not following symlinks
+    uint64_t Inode;
+};
+
+// A reviewed --no-op run written to disk, to be applied later without walking the tree again. Entries are
+// kept in the order they must be applied, which is every entry before the entry of its parent directory, so
+// sources are always the original paths. Sources are made absolute when added, so the plan can be applied from any
+// directory.
+class RenamePlan
+{
+  public:
+    static const uint32_t NoParent = UINT32_MAX;
+
+    // For writing. Ids are the renamer's directory ids, resolved to entry indices when saved.
+    void Add(std::string_view source, std::string_view target, size_t directoryId, size_t parentId, uint32_t flags,
+             uint64_t device, uint64_t inode);
+    bool Save(std::filesystem::path const &path);
+
+    // For reading
+    bool Load(std::filesystem::path const &path);
+
+    uint64_t Count() const
+    {
+        return m_recordCount;
+    }
+
+    PlanEntry Entry(uint64_t index) const;
+
+  private:
+    struct Header
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint64_t RecordCount;
+        uint64_t StringsSize;
+    };
+
+    struct Record
+    {
+        uint64_t SourceOffset;
+        uint64_t TargetOffset;
+        uint32_t SourceLength;
+        uint32_t TargetLength;
+        uint32_t Parent;
+        uint32_t Flags;
+        uint64_t Device;
+        uint64_t Inode;
+    };
+
+    uint64_t AddString(std::string_view s);
+
+    MappedFile m_file;
+    const Record *m_records = nullptr;
+    uint64_t m_recordCount = 0;
+    const char *m_strings = nullptr;
+
+    std::vector<Record> m_newRecords;
+    std::vector<size_t> m_newParentIds;
+    std::unordered_map<size_t, uint32_t> m_directoryRecords;
+    std::string m_newStrings;
+    std::filesystem::path m_currentDirectory;
+};
+
+} // namespace AsciiRename
+
+#endif
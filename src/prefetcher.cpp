@@ -0,0 +1,106 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include "prefetcher.h"
+
+namespace AsciiRename
+{
+
+DirectoryPrefetcher::DirectoryPrefetcher(unsigned threads) : m_pool(threads)
+{
+}
+
+DirectoryPrefetcher::~DirectoryPrefetcher()
+{
+    // Reads still queued don't need doing
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &request : m_requests)
+    {
+        request.second->Cancelled = true;
+    }
+}
+
+size_t DirectoryPrefetcher::Request(NativeString path)
+{
+    auto request = std::make_shared<PendingRead>();
+    request->Path = std::move(path);
+
+    size_t id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = ++m_lastId;
+        m_requests[id] = request;
+    }
+
+    m_pool.Submit([this, request]() {
+        if (!request->Cancelled)
+        {
+            Read(*request);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            request->Done = true;
+        }
+        m_done.notify_all();
+    });
+
+    return id;
+}
+
+void DirectoryPrefetcher::Read(PendingRead &request)
+{
+    auto &listing = request.Listing;
+    auto reader = DirectoryReader();
+    auto entry = DirectoryEntry();
+
+    if (reader.Open(request.Path.c_str(), listing.Error))
+    {
+        while (!request.Cancelled && reader.Next(entry, listing.Error))
+        {
+            listing.Entries.push_back({listing.Names.size(), entry.Name.size(), entry.Type, entry.Inode});
+            listing.Names.append(entry.Name);
+        }
+    }
+}
+
+bool DirectoryPrefetcher::TryTake(size_t id, DirectoryListing &listing)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_requests.find(id);
+    if (it == m_requests.end())
+    {
+        return false;
+    }
+
+    auto request = it->second;
+    m_requests.erase(it);
+    m_done.wait(lock, [&request] { return request->Done; });
+
+    if (request->Cancelled)
+    {
+        return false;
+    }
+
+    listing = std::move(request->Listing);
+    return true;
+}
+
+void DirectoryPrefetcher::Cancel(size_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_requests.find(id);
+    if (it != m_requests.end())
+    {
+        it->second->Cancelled = true;
+        m_requests.erase(it);
+    }
+}
+
+size_t DirectoryPrefetcher::Pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests.size();
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,88 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "dirreader.h"
+#include "nativepath.h"
+#include "threadpool.h"
+
+namespace AsciiRename
+{
+
+// A directory's entries, read ahead of time
+struct DirectoryListing
+{
+    struct Entry
+    {
+        size_t NameOffset;
+        size_t NameLength;
+        EntryType Type;
+        uint64_t Inode;
+    };
+
+    NativeString Names;
+    std::vector<Entry> Entries;
+    std::error_code Error; // Set if the directory couldn't be opened or read to the end
+
+    DirectoryEntry At(size_t index) const
+    {
+        auto const &entry = Entries[index];
+        return {NativeStringView(Names.data() + entry.NameOffset, entry.NameLength), entry.Type, entry.Inode};
+    }
+};
+
+// Reads directories on background threads before they're needed, so the caller doesn't have to wait on the
+// file system when it gets to them
+class DirectoryPrefetcher
+{
+  public:
+    explicit DirectoryPrefetcher(unsigned threads);
+    ~DirectoryPrefetcher();
+
+    // Returns an id for Take or Cancel
+    size_t Request(NativeString path);
+
+    // Waits for a requested directory to be read, and moves its listing out
+    bool TryTake(size_t id, DirectoryListing &listing);
+
+    // Drops a directory which turned out not to be needed, skipping the read if it hasn't started yet
+    void Cancel(size_t id);
+
+    size_t Pending() const;
+
+  private:
+    DirectoryPrefetcher(const DirectoryPrefetcher &) = delete;
+    DirectoryPrefetcher &operator=(const DirectoryPrefetcher &) = delete;
+
+    struct PendingRead
+    {
+        NativeString Path;
+        DirectoryListing Listing;
+        bool Done = false;
+        std::atomic<bool> Cancelled{false};
+    };
+
+    static void Read(PendingRead &request);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::unordered_map<size_t, std::shared_ptr<PendingRead>> m_requests;
+    size_t m_lastId = 0;
+    ThreadPool m_pool;
+};
+
+} // namespace AsciiRename
+
+#endif
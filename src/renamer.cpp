@@ -0,0 +1,1014 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include <libpu8.h>
+
+#include "dirreader.h"
+#include "helpers.h"
+#include "metadata.h"
+#include "renamer.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+Renamer::Renamer(RenameOptions const &options) : m_options(options)
+{
+    // The walk itself is serial, so an adaptive window can only find more throughput by reading ahead in parallel
+    m_adaptivePrefetch = m_options.Recursive && GetIoLimits().Adaptive;
+    if (m_options.Recursive && (m_options.Prefetch > 0 || m_adaptivePrefetch))
+    {
+        unsigned threads = m_options.Prefetch > 0 ? m_options.Prefetch : MaxPrefetchThreads;
+        m_prefetcher = std::make_unique<DirectoryPrefetcher>(std::min(threads, MaxPrefetchThreads));
+    }
+}
+
+bool Renamer::LoadIndex()
+{
+    return m_options.IndexFile == nullptr || m_index.Load(u8widen(m_options.IndexFile));
+}
+
+bool Renamer::SaveIndex()
+{
+    return m_options.IndexFile == nullptr || m_options.NoOp || m_index.Save(u8widen(m_options.IndexFile));
+}
+
+bool Renamer::SavePlan()
+{
+    return m_options.PlanOutFile == nullptr || !m_options.NoOp || m_plan.Save(u8widen(m_options.PlanOutFile));
+}
+
+void Renamer::AddPath(NativeString const &path, int depth, uint64_t rootDevice)
+{
+    m_rootPaths.push_back({path, depth, rootDevice});
+    TrimTrailingPathSeparator(m_rootPaths.back().Path);
+}
+
+void Renamer::ProcessPaths()
+{
+    m_visited.clear();
+
+    if (m_options.FixSymlinks)
+    {
+        auto ec = std::error_code();
+        m_currentDirectory = std::filesystem::current_path(ec);
+    }
+
+    for (auto const &root : m_rootPaths)
+    {
+        m_paths.assign(root.Path);
+        m_paths.push_back(0);
+        auto item = PathItem();
+        item.PathLength = root.Path.size();
+        item.Depth = root.Depth;
+        item.RootDevice = root.RootDevice;
+        m_pathItems.push_back(item);
+
+        while (!m_pathItems.empty())
+        {
+            auto rawItem = m_pathItems.back();
+            m_pathItems.pop_back();
+
+            if (!ProcessItem(rawItem))
+            {
+                if (rawItem.PrefetchId != 0)
+                {
+                    // Directory was read ahead for nothing, or its listing was already used
+                    m_prefetcher->Cancel(rawItem.PrefetchId);
+                }
+
+                // Item is done, and its path is at the top of the buffer
+                m_paths.resize(rawItem.PathOffset);
+            }
+        }
+    }
+
+    m_rootPaths.clear();
+
+    if (m_options.FixSymlinks)
+    {
+        FixSymlinks();
+    }
+}
+
+void Renamer::PushChild(PathItem const &parent, NativeStringView name, size_t parentId, EntryType type,
+                        std::string_view target, bool truncated)
+{
+    auto offset = m_paths.size();
+    AppendNativePath(m_paths, ItemPath(parent), name);
+    auto length = m_paths.size() - offset;
+    m_paths.push_back(0);
+
+    if (!target.empty())
+    {
+        AppendAscii(m_paths, target);
+        m_paths.push_back(0);
+    }
+
+    auto item = PathItem();
+    item.PathOffset = offset;
+    item.PathLength = length;
+    item.Depth = parent.Depth + 1;
+    item.RootDevice = parent.RootDevice;
+    item.ParentId = parentId;
+    item.IsDirectory = type == EntryType::Directory;
+    item.Type = type;
+    item.TargetLength = target.size();
+    item.Truncated = truncated;
+    m_pathItems.push_back(item);
+}
+
+void Renamer::PrefetchUpcoming()
+{
+    if (!m_prefetcher)
+    {
+        return;
+    }
+
+    // With an adaptive window, as many directories are read ahead as it allows at once, up to --prefetch if given
+    size_t depth = m_options.Prefetch;
+    if (m_adaptivePrefetch)
+    {
+        depth = GetAdaptiveWindowStats().Window;
+        if (m_options.Prefetch > 0)
+        {
+            depth = std::min<size_t>(depth, m_options.Prefetch);
+        }
+    }
+
+    // Look for the directories nearest the top of the stack, which are the ones which will be reached soonest
+    const size_t ScanLimit = 4096;
+    size_t scanned = 0;
+    size_t inFlight = m_prefetcher->Pending();
+
+    for (auto item = m_pathItems.rbegin(); item != m_pathItems.rend() && scanned < ScanLimit && inFlight < depth;
+         ++item, ++scanned)
+    {
+        if (item->Type == EntryType::Directory && !item->SubsScanned && item->PrefetchId == 0 &&
+            (m_options.MaxDepth < 0 || item->Depth < m_options.MaxDepth))
+        {
+            item->PrefetchId = m_prefetcher->Request(NativeString(ItemPath(*item)));
+            ++inFlight;
+        }
+    }
+}
+
+void Renamer::PlanChunk(ChildChunk &chunk, NameSet &names)
+{
+    auto utf8Buffer = std::string();
+    auto utf8Name = std::string_view();
+    auto target = std::string();
+    bool truncated = false;
+
+    for (auto &child : chunk.Children)
+    {
+        auto name = NativeStringView(chunk.Names.data() + child.NameOffset, child.NameLength);
+        names.Add(name);
+
+        // Failures are left for the main thread to report, in order
+        child.TargetLength = 0;
+        if (TryGetUtf8View(name, utf8Buffer, utf8Name) && TryGetAsciiName(utf8Name, target, truncated))
+        {
+            child.TargetOffset = chunk.Targets.size();
+            child.TargetLength = target.size();
+            child.Truncated = truncated;
+            chunk.Targets.append(target);
+        }
+    }
+}
+
+void Renamer::SubmitChunk(ChildChunk &chunk, NameSet &names)
+{
+    if (m_options.Jobs == 1)
+    {
+        PlanChunk(chunk, names);
+        return;
+    }
+
+    if (!m_pool)
+    {
+        m_pool = std::make_unique<ThreadPool>(m_options.Jobs);
+    }
+    m_pool->Submit([&chunk, &names]() { PlanChunk(chunk, names); });
+}
+
+// Plan targets are only trusted as a single ASCII name, so a damaged plan can't move anything out of its directory
+static bool IsValidPlanTarget(std::string_view target)
+{
+    if (target.empty() || target == "." || target == "..")
+    {
+        return false;
+    }
+
+    for (char c : target)
+    {
+        auto byte = (unsigned char)c;
+#ifdef _WIN32
+        if (c == '\\')
+        {
+            return false;
+        }
+#endif
+        if (byte == 0 || byte >= 0x80 || c == '/')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Renamer::ApplyPlan(RenamePlan const &plan)
+{
+    // Entries inside a directory come before it, and a directory isn't renamed unless they all were, or they'd be
+    // left behind under its old name in the plan
+    auto blocked = std::vector<bool>(plan.Count());
+
+    for (uint64_t i = 0; i < plan.Count(); i++)
+    {
+        auto entry = plan.Entry(i);
+        if (!ApplyPlanEntry(entry, blocked[i]) && entry.Parent != RenamePlan::NoParent)
+        {
+            blocked[entry.Parent] = true;
+        }
+    }
+}
+
+bool Renamer::ApplyPlanEntry(PlanEntry const &entry, bool blocked)
+{
+    auto ec = std::error_code();
+
+#ifdef _WIN32
+    auto sourceBuffer = u8widen(entry.Source.data(), entry.Source.size());
+    auto source = NativeStringView(sourceBuffer);
+#else
+    auto source = entry.Source;
+#endif
+    auto parts = SplitNativePath(source);
+
+    if (!IsValidPlanTarget(entry.Target))
+    {
+        std::cerr << "ERROR: Plan entry for \"" << entry.Source << "\" has an invalid new name, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Convert, entry.Source, std::make_error_code(std::errc::invalid_argument));
+        return false;
+    }
+
+    if (blocked)
+    {
+        std::cerr << "ERROR: Not everything in \"" << entry.Source << "\" was renamed, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Rename, entry.Source, std::make_error_code(std::errc::operation_canceled));
+        return false;
+    }
+
+    // Symlinks themselves are renamed, so they're never followed here
+    auto status = FileStatus();
+    if (!TryGetFileStatus(source.data(), false, status, ec))
+    {
+        std::cerr << "ERROR: \"" << entry.Source << "\" doesn't exist anymore, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Stat, entry.Source, ec);
+        return false;
+    }
+
+    if (status.Device != entry.Device || status.Inode != entry.Inode)
+    {
+        // Something else has the name now, which was never reviewed
+        std::cerr << "ERROR: \"" << entry.Source << "\" was replaced since it was planned, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Stat, entry.Source, std::make_error_code(std::errc::no_such_file_or_directory));
+        return false;
+    }
+
+    m_newPath.assign(parts.Directory);
+    AppendAscii(m_newPath, entry.Target);
+    auto newPathStr = Utf8(m_newPath, m_utf8NewBuffer);
+
+    auto originalName = std::string_view();
+    bool sameName = TryGetUtf8View(parts.Name, m_nameBuffer, originalName) &&
+                    NameSet::Equal(originalName, entry.Target, IsCaseInsensitive(source.data(), status.Device));
+
+    if (!m_options.Overwrite && !sameName && TryGetFileStatus(m_newPath.c_str(), false, status, ec))
+    {
+        std::cerr << "ERROR: \"" << newPathStr << "\" already exists.\n";
+        std::cerr << "ERROR: Specify --overwrite to overwrite.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Collision, entry.Source, std::make_error_code(std::errc::file_exists));
+        return false;
+    }
+
+    auto note = (entry.Flags & PlanTruncated) != 0 ? " (truncated to fit)" : "";
+
+    if (m_options.NoOp)
+    {
+        std::cout << "Would have renamed \"" << entry.Source << "\" to \"" << newPathStr << "\"" << note << "...\n";
+        ++m_renames;
+        m_truncated += (entry.Flags & PlanTruncated) != 0 ? 1 : 0;
+        return true;
+    }
+
+    std::cout << "Renaming \"" << entry.Source << "\" to \"" << newPathStr << "\"" << note << "...\n";
+
+    if (TryRenameNativePath(source.data(), m_newPath.c_str(), m_options.Overwrite || sameName, ec))
+    {
+        ++m_renames;
+        m_truncated += (entry.Flags & PlanTruncated) != 0 ? 1 : 0;
+
+        if (m_renamedCallback)
+        {
+            m_renamedCallback(std::filesystem::path(source), std::filesystem::path(m_newPath));
+        }
+        return true;
+    }
+
+    if (ec == std::errc::file_exists)
+    {
+        std::cerr << "ERROR: \"" << newPathStr << "\" already exists.\n";
+        std::cerr << "ERROR: Specify --overwrite to overwrite.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Collision, entry.Source, ec);
+    }
+    else
+    {
+        std::cerr << "ERROR: File system error, unable to rename \"" << entry.Source << "\" to \"" << newPathStr
+                  << "\": " << ec.message() << ".\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Rename, entry.Source, ec);
+    }
+    return false;
+}
+
+NameSet &Renamer::AcquireNames(size_t directoryId, bool caseInsensitive)
+{
+    auto names = std::unique_ptr<NameSet>();
+    if (m_spareNames.empty())
+    {
+        names = std::make_unique<NameSet>(caseInsensitive);
+    }
+    else
+    {
+        names = std::move(m_spareNames.back());
+        m_spareNames.pop_back();
+        names->Reset(caseInsensitive);
+    }
+
+    auto &result = *names;
+    m_directoryNames[directoryId] = std::move(names);
+    return result;
+}
+
+void Renamer::ReleaseNames(size_t directoryId)
+{
+    auto names = m_directoryNames.find(directoryId);
+    if (names != m_directoryNames.end())
+    {
+        m_spareNames.push_back(std::move(names->second));
+        m_directoryNames.erase(names);
+    }
+}
+
+bool Renamer::IsCaseInsensitive(const NativeChar *path, uint64_t device)
+{
+    if (m_options.Case != CaseSensitivity::Auto)
+    {
+        return m_options.Case == CaseSensitivity::Insensitive;
+    }
+
+    auto cached = m_caseInsensitiveDevices.find(device);
+    if (cached != m_caseInsensitiveDevices.end())
+    {
+        return cached->second;
+    }
+
+    bool caseInsensitive = false;
+    auto ec = std::error_code();
+    if (!TryGetCaseInsensitive(path, caseInsensitive, ec))
+    {
+        caseInsensitive = false;
+    }
+    m_caseInsensitiveDevices.emplace(device, caseInsensitive);
+    return caseInsensitive;
+}
+
+void Renamer::PrintSummary() const
+{
+    std::cout << "Renamed: " << m_renames << ", Skipped: " << m_skipped << ", Total: " << m_renames + m_skipped
+              << "\n";
+
+    auto counters = GetMetadataCounters();
+    std::cout << "Lookups: " << counters.Lookups;
+    if (counters.NoSyncLookups > 0)
+    {
+        std::cout << " (without syncing: " << counters.NoSyncLookups << ")";
+    }
+    std::cout << ", Avoided: " << m_lookupsAvoided << "\n";
+
+    auto throttle = GetThrottleCounters();
+    if (throttle.Waits > 0)
+    {
+        std::cout << "Throttled: " << throttle.Waits << " (" << throttle.WaitNanoseconds / 1000000 << " ms)\n";
+    }
+
+    if (GetIoLimits().Adaptive)
+    {
+        auto window = GetAdaptiveWindowStats();
+        std::cout << "In-flight window: " << window.Window << " (Largest: " << window.LargestWindow
+                  << ", Decreases: " << window.Decreases << ")\n";
+    }
+
+    if (m_truncated > 0)
+    {
+        std::cout << "Truncated: " << m_truncated << "\n";
+    }
+
+    if (m_symlinksFixed > 0)
+    {
+        std::cout << "Symlinks updated: " << m_symlinksFixed << "\n";
+    }
+
+    if (m_errors > 0)
+    {
+        std::cout << "Errors: " << m_errors << " (Convert: " << Errors(ErrorOperation::Convert)
+                  << ", Stat: " << Errors(ErrorOperation::Stat)
+                  << ", Read Directory: " << Errors(ErrorOperation::ReadDirectory)
+                  << ", Collision: " << Errors(ErrorOperation::Collision)
+                  << ", Rename: " << Errors(ErrorOperation::Rename) << ")\n";
+    }
+}
+
+void Renamer::RecordError(ErrorOperation operation, std::string_view path, std::error_code const &ec)
+{
+    ++m_errors;
+    ++m_errorCounts[(size_t)operation];
+    m_errorRecords.push_back({std::string(path), operation, ec});
+}
+
+std::string_view Renamer::Utf8(NativeStringView path, std::string &buffer)
+{
+    auto result = std::string_view();
+    if (!TryGetUtf8View(path, buffer, result))
+    {
+        return "?";
+    }
+    return result;
+}
+
+std::filesystem::path Renamer::AbsolutePath(NativeStringView path) const
+{
+    return (m_currentDirectory / std::filesystem::path(path)).lexically_normal();
+}
+
+void Renamer::RecordRenamedPath(NativeStringView originalPath)
+{
+    auto &newName = m_renamedPaths[AbsolutePath(originalPath).native()];
+    newName.clear();
+    AppendAscii(newName, m_asciiName);
+}
+
+std::filesystem::path Renamer::CurrentPath(std::filesystem::path const &original) const
+{
+    auto prefix = std::filesystem::path();
+    auto current = std::filesystem::path();
+    for (auto const &part : original)
+    {
+        prefix /= part;
+        auto renamed = m_renamedPaths.find(prefix.native());
+        current /= renamed != m_renamedPaths.end() ? std::filesystem::path(renamed->second) : part;
+    }
+    return current;
+}
+
+std::filesystem::path Renamer::RenamedTarget(std::filesystem::path const &linkDirectory,
+                                             std::filesystem::path const &target) const
+{
+    // The target keeps its shape, relative or absolute, with the same number of "..", and only the names of
+    // renamed entries change. ".." is taken lexically, as the renames were only recorded by path.
+    auto original = target.is_absolute() ? std::filesystem::path() : linkDirectory;
+    auto result = std::filesystem::path();
+    for (auto const &part : target)
+    {
+        if (part == "..")
+        {
+            original = original.parent_path();
+        }
+        else if (part != "." && !part.empty())
+        {
+            original /= part;
+            auto renamed = m_renamedPaths.find(original.native());
+            if (renamed != m_renamedPaths.end())
+            {
+                result /= renamed->second;
+                continue;
+            }
+        }
+        result /= part;
+    }
+    return result;
+}
+
+void Renamer::FixSymlinks()
+{
+    auto ec = std::error_code();
+    for (auto const &original : m_symlinks)
+    {
+        // Nothing was renamed in a no-op run, so links are still where they were found
+        auto link = m_options.NoOp ? original : CurrentPath(original);
+        auto linkStr = Utf8(link.native(), m_utf8Buffer);
+
+        auto target = std::filesystem::read_symlink(link, ec);
+        if (ec)
+        {
+            std::cerr << "ERROR: Unable to read symlink \"" << linkStr << "\": " << ec.message() << ".\n";
+            RecordError(ErrorOperation::Stat, linkStr, ec);
+            continue;
+        }
+
+        auto newTarget = RenamedTarget(original.parent_path(), target);
+        if (newTarget == target)
+        {
+            continue;
+        }
+
+        auto newTargetStr = Utf8(newTarget.native(), m_utf8NewBuffer);
+        if (m_options.NoOp)
+        {
+            std::cout << "Would have pointed symlink \"" << linkStr << "\" at \"" << newTargetStr << "\"...\n";
+            ++m_symlinksFixed;
+        }
+        else
+        {
+            std::cout << "Pointing symlink \"" << linkStr << "\" at \"" << newTargetStr << "\"...\n";
+            if (TryReplaceSymlink(link, newTarget, ec))
+            {
+                ++m_symlinksFixed;
+            }
+            else
+            {
+                std::cerr << "ERROR: File system error, unable to replace symlink \"" << linkStr
+                          << "\": " << ec.message() << ".\n";
+                RecordError(ErrorOperation::Rename, linkStr, ec);
+            }
+        }
+    }
+
+    m_symlinks.clear();
+    m_renamedPaths.clear();
+}
+
+bool Renamer::ProcessItem(PathItem &rawItem)
+{
+    auto originalPath = ItemPath(rawItem);
+    auto parts = SplitNativePath(originalPath);
+
+    auto originalName = std::string_view();
+    if (!TryGetUtf8View(parts.Name, m_nameBuffer, originalName))
+    {
+        std::cerr << "ERROR: Unable convert a path to UTF8, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Convert, "", std::make_error_code(std::errc::illegal_byte_sequence));
+        return false;
+    }
+
+    auto originalPathStr = Utf8(originalPath, m_utf8Buffer);
+
+    if (m_options.Verbose)
+    {
+        std::cout << "Processing \"" << originalPathStr << "\"...\n";
+    }
+
+    bool truncated = rawItem.Truncated;
+    if (rawItem.TargetLength != 0)
+    {
+        // Already worked out on the thread pool
+        auto target = ItemTarget(rawItem);
+        m_asciiName.assign(target.begin(), target.end());
+    }
+    else if (!TryGetAsciiName(originalName, m_asciiName, truncated))
+    {
+        std::cerr << "ERROR: Unable convert path \"" << originalPathStr << "\" to ASCII, skipping.\n";
+        ++m_skipped;
+        RecordError(ErrorOperation::Convert, originalPathStr, std::make_error_code(std::errc::illegal_byte_sequence));
+        return false;
+    }
+
+    bool skip = false;
+    bool renamed = false;
+    auto status = FileStatus();
+    auto ec = std::error_code();
+
+    // What the listing says is enough for anything that won't be walked, which is most entries
+    bool typeKnown =
+        rawItem.Type == EntryType::Other || (rawItem.Type == EntryType::Symlink && !m_options.FollowSymlinks);
+
+    if (typeKnown)
+    {
+        status = {false, rawItem.Type == EntryType::Symlink, 0, 0};
+        ++m_lookupsAvoided;
+    }
+
+    if (!typeKnown && !TryGetFileStatus(originalPath.data(), m_options.FollowSymlinks, status, ec))
+    {
+        if (ec == std::errc::no_such_file_or_directory)
+        {
+            std::cerr << "ERROR: \"" << originalPathStr << "\" doesn't exist.\n";
+        }
+        else
+        {
+            std::cerr << "ERROR: Unable to access \"" << originalPathStr << "\": " << ec.message() << ".\n";
+        }
+        skip = true;
+        RecordError(ErrorOperation::Stat, originalPathStr, ec);
+    }
+    else
+    {
+        rawItem.IsDirectory = status.IsDirectory;
+
+        bool descend = m_options.Recursive && !rawItem.SubsScanned && rawItem.IsDirectory;
+
+        if (descend && m_options.MaxDepth >= 0 && rawItem.Depth >= m_options.MaxDepth)
+        {
+            if (m_options.Verbose)
+            {
+                std::cout << "Not recursing into \"" << originalPathStr << "\", max depth reached.\n";
+            }
+            descend = false;
+        }
+
+        if (descend && m_options.OneFileSystem)
+        {
+            if (rawItem.Depth == 0)
+            {
+                rawItem.RootDevice = status.Device;
+            }
+            else if (status.Device != rawItem.RootDevice)
+            {
+                if (m_options.Verbose)
+                {
+                    std::cout << "Not recursing into \"" << originalPathStr << "\", it's on a different file system.\n";
+                }
+                descend = false;
+            }
+        }
+
+        if (descend && !m_visited.insert({status.Device, status.Inode}).second)
+        {
+            // Reached again through a symlink, or given more than once
+            if (m_options.Verbose)
+            {
+                std::cout << "Not recursing into \"" << originalPathStr << "\", it was already visited.\n";
+            }
+            descend = false;
+        }
+
+        if (descend)
+        {
+            // Looking at a directory and recursive is true, so:
+            // 1. Push item itself back onto the stack but with scanning disabled
+            // 2. Push children on top of the parent, so they'll get processed first
+
+            if (m_options.Verbose)
+            {
+                std::cout << "Re-adding \"" << originalPathStr << "\" and children to queue...\n";
+                std::cout << "Skipping \"" << originalPathStr << "\" for now...\n";
+            }
+
+            size_t directoryId = ++m_lastDirectoryId;
+            auto item = rawItem;
+            item.SubsScanned = true;
+            item.DirectoryId = directoryId;
+            m_pathItems.push_back(item);
+
+            // Careful, pushing children may move the paths buffer
+            auto info = FileInfo();
+            auto subdirs = std::vector<std::string>();
+            bool haveInfo = m_options.IndexFile != nullptr && TryGetFileInfo(originalPath.data(), info, ec);
+
+            if (haveInfo && m_index.TryGetSubdirectories(info, subdirs))
+            {
+                // Directory hasn't changed since it was last processed, so only its subdirectories need a look
+                if (m_options.Verbose)
+                {
+                    std::cout << "\"" << originalPathStr << "\" is unchanged, only re-adding subdirectories...\n";
+                }
+
+                for (const auto &subdir : subdirs)
+                {
+                    PushChild(item, u8widen(subdir), directoryId, EntryType::Directory);
+                }
+            }
+            else
+            {
+                if (haveInfo)
+                {
+                    m_index.Invalidate(info);
+                }
+
+                auto reader = DirectoryReader();
+                auto entry = DirectoryEntry();
+                auto listing = DirectoryListing();
+                size_t listed = 0;
+                bool prefetched = m_prefetcher && rawItem.PrefetchId != 0 &&
+                                  m_prefetcher->TryTake(rawItem.PrefetchId, listing);
+
+                // Entries come from the prefetched listing if there is one, or else straight from the reader
+                auto nextEntry = [&]() {
+                    if (!prefetched)
+                    {
+                        return reader.Next(entry, ec);
+                    }
+                    if (listed == listing.Entries.size())
+                    {
+                        ec = listing.Error;
+                        return false;
+                    }
+                    entry = listing.At(listed++);
+                    return true;
+                };
+
+                auto &names = AcquireNames(directoryId, IsCaseInsensitive(originalPath.data(), status.Device));
+
+                // The start of the listing is handled here as it's read, and only when a directory turns out to be
+                // huge is the rest split into chunks for the pool, while reading continues. Sorting by inode needs
+                // the whole listing first, so then all of it goes into chunks.
+                const size_t ChunkSize = 4096;
+                auto chunks = std::vector<std::unique_ptr<ChildChunk>>();
+                size_t count = 0;
+
+                if (prefetched || reader.Open(originalPath.data(), ec))
+                {
+                    while (nextEntry())
+                    {
+                        if (!m_options.InodeOrder && (count++ < ChunkSize || m_options.Jobs == 1))
+                        {
+                            names.Add(entry.Name);
+                            PushChild(item, entry.Name, directoryId, entry.Type);
+                            continue;
+                        }
+
+                        if (chunks.empty() || chunks.back()->Children.size() == ChunkSize)
+                        {
+                            if (!chunks.empty())
+                            {
+                                SubmitChunk(*chunks.back(), names);
+                            }
+                            chunks.push_back(std::make_unique<ChildChunk>());
+                        }
+
+                        auto &chunk = *chunks.back();
+                        chunk.Children.push_back(
+                            {chunk.Names.size(), entry.Name.size(), entry.Type, entry.Inode, 0, 0, false});
+                        chunk.Names.append(entry.Name);
+                    }
+                }
+
+                if (!chunks.empty())
+                {
+                    if (chunks.size() == 1)
+                    {
+                        // Not worth handing off
+                        PlanChunk(*chunks.back(), names);
+                    }
+                    else
+                    {
+                        SubmitChunk(*chunks.back(), names);
+                        if (m_pool)
+                        {
+                            m_pool->Wait();
+                        }
+                    }
+
+                    auto children = std::vector<std::pair<ChildChunk const *, ChildChunk::Child const *>>();
+                    for (auto const &chunk : chunks)
+                    {
+                        for (auto const &child : chunk->Children)
+                        {
+                            children.emplace_back(chunk.get(), &child);
+                        }
+                    }
+
+                    if (m_options.InodeOrder)
+                    {
+                        // Pushed highest first, so they're popped, looked up and renamed lowest first
+                        std::stable_sort(children.begin(), children.end(), [](auto const &a, auto const &b) {
+                            return a.second->Inode > b.second->Inode;
+                        });
+                    }
+
+                    for (auto const &[chunk, child] : children)
+                    {
+                        auto name = NativeStringView(chunk->Names.data() + child->NameOffset, child->NameLength);
+                        auto target =
+                            std::string_view(chunk->Targets.data() + child->TargetOffset, child->TargetLength);
+                        PushChild(item, name, directoryId, child->Type, target, child->Truncated);
+                    }
+                }
+
+                if (ec)
+                {
+                    // Only a complete set of names can stand in for probing
+                    ReleaseNames(directoryId);
+
+                    auto pathStr = Utf8(ItemPath(item), m_utf8Buffer);
+                    std::cerr << "ERROR: Unable to read directory \"" << pathStr << "\": " << ec.message() << ".\n";
+                    RecordError(ErrorOperation::ReadDirectory, pathStr, ec);
+                }
+            }
+
+            if (m_options.IndexFile != nullptr)
+            {
+                m_pendingDirectories[directoryId] = {m_errors, {}};
+            }
+
+            PrefetchUpcoming();
+
+            return true;
+        }
+        else if (originalName == m_asciiName)
+        {
+            // Path doesn't change with ASCII transliteration
+            if (m_options.Verbose)
+            {
+                std::cout << "No need to rename \"" << originalPathStr << "\".\n";
+            }
+            skip = true;
+        }
+        else
+        {
+            m_newPath.assign(parts.Directory);
+            AppendAscii(m_newPath, m_asciiName);
+
+            auto newPathStr = Utf8(m_newPath, m_utf8NewBuffer);
+            auto note = truncated ? " (truncated to fit)" : "";
+
+            // The parent's listing knows how its file system compares names. Without one, the entry's own file system
+            // is the same as its parent's unless it's a mount point, which can't be renamed anyway.
+            auto names = m_directoryNames.find(rawItem.ParentId);
+            bool caseInsensitive = false;
+            if (names != m_directoryNames.end())
+            {
+                caseInsensitive = names->second->CaseInsensitive();
+            }
+            else if (!typeKnown)
+            {
+                caseInsensitive = IsCaseInsensitive(originalPath.data(), status.Device);
+            }
+            else if (m_options.Case != CaseSensitivity::Auto ||
+                     !TryGetCaseInsensitive(originalPath.data(), caseInsensitive, ec))
+            {
+                caseInsensitive = m_options.Case == CaseSensitivity::Insensitive;
+            }
+
+            bool exists = false;
+            if (!m_options.Overwrite)
+            {
+                if (names != m_directoryNames.end())
+                {
+                    exists = names->second->Contains(m_asciiName) &&
+                             !NameSet::Equal(originalName, m_asciiName, caseInsensitive);
+                }
+                else
+                {
+                    // Only the case changed, which is no collision on a case-insensitive file system. A dangling
+                    // symlink still takes up the name, so don't follow them.
+                    auto newStatus = FileStatus();
+                    exists = TryGetFileStatus(m_newPath.c_str(), false, newStatus, ec) &&
+                             !NameSet::Equal(originalName, m_asciiName, caseInsensitive);
+                }
+            }
+
+            if (exists)
+            {
+                // New path already exists, but overwrite is false
+                std::cerr << "ERROR: \"" << newPathStr << "\" already exists.\n";
+                std::cerr << "ERROR: Specify --overwrite to overwrite.\n";
+                skip = true;
+                RecordError(ErrorOperation::Collision, originalPathStr, std::make_error_code(std::errc::file_exists));
+            }
+            else if (m_options.NoOp)
+            {
+                // Just a single path rename
+                std::cout << "Would have renamed \"" << originalPathStr << "\" to \"" << newPathStr << "\"" << note
+                          << "...\n";
+                ++m_renames;
+                if (m_options.PlanOutFile != nullptr)
+                {
+                    // The plan checks it renames the very entry that was planned, which is the symlink itself
+                    // rather than anything it points at, and may not have been looked up yet
+                    auto identity = status;
+                    if ((typeKnown || m_options.FollowSymlinks) &&
+                        !TryGetFileStatus(originalPath.data(), false, identity, ec))
+                    {
+                        identity = FileStatus();
+                    }
+                    uint32_t flags = (rawItem.IsDirectory ? (uint32_t)PlanDirectory : 0u) |
+                                     (truncated ? (uint32_t)PlanTruncated : 0u);
+                    m_plan.Add(originalPathStr, m_asciiName, rawItem.DirectoryId, rawItem.ParentId, flags,
+                               identity.Device, identity.Inode);
+                }
+                if (names != m_directoryNames.end())
+                {
+                    // Later names in the same directory need to see this one as taken
+                    names->second->Remove(originalName);
+                    names->second->Add(m_asciiName);
+                }
+                m_truncated += truncated ? 1 : 0;
+                if (m_options.FixSymlinks)
+                {
+                    RecordRenamedPath(originalPath);
+                }
+            }
+            else
+            {
+                std::cout << "Renaming \"" << originalPathStr << "\" to \"" << newPathStr << "\"" << note << "...\n";
+
+                // A case-only change renames the entry onto itself, which mustn't count as a collision
+                bool replace = m_options.Overwrite || NameSet::Equal(originalName, m_asciiName, caseInsensitive);
+                if (TryRenameNativePath(originalPath.data(), m_newPath.c_str(), replace, ec))
+                {
+                    renamed = true;
+                    ++m_renames;
+                    if (names != m_directoryNames.end())
+                    {
+                        names->second->Remove(originalName);
+                        names->second->Add(m_asciiName);
+                    }
+                    m_truncated += truncated ? 1 : 0;
+
+                    if (m_options.FixSymlinks)
+                    {
+                        RecordRenamedPath(originalPath);
+                    }
+
+                    if (m_renamedCallback)
+                    {
+                        m_renamedCallback(std::filesystem::path(originalPath), std::filesystem::path(m_newPath));
+                    }
+                }
+                else if (ec == std::errc::file_exists)
+                {
+                    // Something took the new path since the directory was listed
+                    std::cerr << "ERROR: \"" << newPathStr << "\" already exists.\n";
+                    std::cerr << "ERROR: Specify --overwrite to overwrite.\n";
+                    skip = true;
+                    RecordError(ErrorOperation::Collision, originalPathStr, ec);
+                }
+                else
+                {
+                    std::cerr << "ERROR: File system error, unable to rename \"" << originalPathStr << "\" to \""
+                              << newPathStr << "\": " << ec.message() << ".\n";
+                    skip = true;
+                    RecordError(ErrorOperation::Rename, originalPathStr, ec);
+                }
+            }
+        }
+
+        if (m_options.FixSymlinks && (status.IsSymlink || rawItem.Type == EntryType::Symlink))
+        {
+            m_symlinks.push_back(AbsolutePath(originalPath));
+        }
+    }
+
+    if (rawItem.DirectoryId != 0)
+    {
+        ReleaseNames(rawItem.DirectoryId);
+    }
+
+    if (m_options.IndexFile != nullptr)
+    {
+        // Record what's needed to mark parent directories clean in the index
+        auto parent = m_pendingDirectories.find(rawItem.ParentId);
+        if (rawItem.IsDirectory && parent != m_pendingDirectories.end())
+        {
+            parent->second.Subdirs.emplace_back(renamed ? m_asciiName : originalName);
+        }
+
+        auto pending = m_pendingDirectories.find(rawItem.DirectoryId);
+        if (pending != m_pendingDirectories.end())
+        {
+            auto info = FileInfo();
+            if (!m_options.NoOp && pending->second.ErrorsBefore == m_errors &&
+                TryGetFileInfo(renamed ? m_newPath.c_str() : originalPath.data(), info, ec))
+            {
+                m_index.MarkClean(info, pending->second.Subdirs);
+            }
+            m_pendingDirectories.erase(pending);
+        }
+    }
+
+    if (skip)
+    {
+        if (m_options.Verbose)
+        {
+            std::cout << "Skipping \"" << originalPathStr << "\"...\n";
+        }
+        ++m_skipped;
+    }
+
+    return false;
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,302 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef RENAMER_H
+#define RENAMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "dirreader.h"
+#include "index.h"
+#include "nameset.h"
+#include "nativepath.h"
+#include "plan.h"
+#include "prefetcher.h"
+#include "threadpool.h"
+
+namespace AsciiRename
+{
+
+enum class CaseSensitivity
+{
+    Auto, // Detected from each path's file system
+    Sensitive,
+    Insensitive,
+};
+
+struct RenameOptions
+{
+    bool NoOp = false;
+    bool Overwrite = false;
+    bool Recursive = false;
+    bool Verbose = false;
+    bool OneFileSystem = false;
+    bool InodeOrder = false;
+    bool FollowSymlinks = false;
+    bool FixSymlinks = false; // Point symlinks at the new names of what they linked to
+    bool Prune = false;       // When linking, remove links made by earlier runs whose originals are gone
+    int MaxDepth = -1;
+    unsigned Jobs = 0;
+    unsigned Prefetch = 0; // How many directories to read ahead
+    const char *IndexFile = nullptr;
+    const char *PlanOutFile = nullptr;
+    CaseSensitivity Case = CaseSensitivity::Auto;
+};
+
+enum class ErrorOperation
+{
+    Convert,       // Path couldn't be converted to UTF-8 or ASCII
+    Stat,          // Path couldn't be looked up
+    ReadDirectory, // Directory couldn't be opened or read
+    Collision,     // New path already exists
+    Rename,        // Rename itself failed
+    Copy,          // Copying into the destination failed
+    Count,
+};
+
+struct ItemError
+{
+    std::string Path;
+    ErrorOperation Operation;
+    std::error_code Code;
+};
+
+// Renames the queued paths (and their children, when recursive) into their ASCII equivalents
+class Renamer
+{
+  public:
+    typedef std::function<void(std::filesystem::path const &, std::filesystem::path const &)> RenamedCallback;
+
+    explicit Renamer(RenameOptions const &options);
+
+    bool LoadIndex();
+    bool SaveIndex();
+
+    // Only writes a plan for --no-op runs
+    bool SavePlan();
+
+    void AddPath(NativeString const &path, int depth = 0, uint64_t rootDevice = 0);
+    void ProcessPaths();
+
+    // Renames the plan's entries in order, checking each source is still the file that was planned and its target is
+    // still free. A directory is only renamed if everything planned inside it was.
+    void ApplyPlan(RenamePlan const &plan);
+
+    // Called after each successful rename with the old and new paths
+    void SetRenamedCallback(RenamedCallback callback)
+    {
+        m_renamedCallback = callback;
+    }
+
+    int Renames() const
+    {
+        return m_renames;
+    }
+
+    int Skipped() const
+    {
+        return m_skipped;
+    }
+
+    // Renames whose new names were truncated to MaxNameLength
+    int Truncated() const
+    {
+        return m_truncated;
+    }
+
+    int Errors() const
+    {
+        return m_errors;
+    }
+
+    int Errors(ErrorOperation operation) const
+    {
+        return m_errorCounts[(size_t)operation];
+    }
+
+    std::vector<ItemError> const &ErrorRecords() const
+    {
+        return m_errorRecords;
+    }
+
+    void PrintSummary() const;
+
+  private:
+    // Items form a stack, and their paths are kept in the same order in m_paths, so once the stack
+    // and buffers have grown to fit the tree, processing an item doesn't allocate
+    struct PathItem
+    {
+        size_t PathOffset = 0;
+        size_t PathLength = 0;
+        bool SubsScanned = false;
+        int Depth = 0;
+        uint64_t RootDevice = 0;
+        size_t ParentId = 0;
+        size_t DirectoryId = 0;
+        bool IsDirectory = false;
+        EntryType Type = EntryType::Unknown; // As listed by the parent directory, if known
+        size_t TargetLength = 0; // Non-zero when the new name was already worked out, and follows the path in m_paths
+        bool Truncated = false;
+        size_t PrefetchId = 0; // Non-zero when the directory is being read ahead
+    };
+
+    // A slice of a huge directory's listing, whose new names are worked out on the thread pool
+    struct ChildChunk
+    {
+        struct Child
+        {
+            size_t NameOffset;
+            size_t NameLength;
+            EntryType Type;
+            uint64_t Inode;
+            size_t TargetOffset;
+            size_t TargetLength;
+            bool Truncated;
+        };
+
+        NativeString Names;
+        std::vector<Child> Children;
+        std::string Targets;
+    };
+
+    struct PendingDirectory
+    {
+        int ErrorsBefore;
+        std::vector<std::string> Subdirs;
+    };
+
+    struct RootPath
+    {
+        NativeString Path;
+        int Depth;
+        uint64_t RootDevice;
+    };
+
+    // Returns whether the item was pushed back onto the stack to be finished after its children
+    bool ProcessItem(PathItem &rawItem);
+    void PushChild(PathItem const &parent, NativeStringView name, size_t parentId, EntryType type,
+                   std::string_view target = std::string_view(), bool truncated = false);
+
+    void PrefetchUpcoming();
+
+    // Returns whether the entry was renamed, or with --no-op, would have been
+    bool ApplyPlanEntry(PlanEntry const &entry, bool blocked);
+
+    static void PlanChunk(ChildChunk &chunk, NameSet &names);
+    void SubmitChunk(ChildChunk &chunk, NameSet &names);
+
+    NativeStringView ItemPath(PathItem const &item) const
+    {
+        return NativeStringView(m_paths.data() + item.PathOffset, item.PathLength);
+    }
+
+    NativeStringView ItemTarget(PathItem const &item) const
+    {
+        return NativeStringView(m_paths.data() + item.PathOffset + item.PathLength + 1, item.TargetLength);
+    }
+
+    std::string_view Utf8(NativeStringView path, std::string &buffer);
+
+    std::filesystem::path AbsolutePath(NativeStringView path) const;
+    void RecordRenamedPath(NativeStringView originalPath);
+
+    // Where a path from before this run's renames is now
+    std::filesystem::path CurrentPath(std::filesystem::path const &original) const;
+
+    // A symlink's target with each component that was renamed replaced by its new name
+    std::filesystem::path RenamedTarget(std::filesystem::path const &linkDirectory,
+                                        std::filesystem::path const &target) const;
+
+    void FixSymlinks();
+
+    void RecordError(ErrorOperation operation, std::string_view path, std::error_code const &ec);
+
+    RenameOptions m_options;
+    RenamedCallback m_renamedCallback;
+
+    std::vector<RootPath> m_rootPaths;
+    std::vector<PathItem> m_pathItems;
+    NativeString m_paths;
+
+    // Scratch buffers reused for every item
+    std::string m_nameBuffer;
+    std::string m_asciiName;
+    NativeString m_newPath;
+    std::string m_utf8Buffer;
+    std::string m_utf8NewBuffer;
+
+    DirectoryIndex m_index;
+    RenamePlan m_plan;
+    std::unordered_map<size_t, PendingDirectory> m_pendingDirectories;
+    size_t m_lastDirectoryId = 0;
+
+    // Names of the directories being processed, by DirectoryId, so new names can be checked without a probe
+    std::unordered_map<size_t, std::unique_ptr<NameSet>> m_directoryNames;
+
+    // Sets from finished directories, kept for later ones so their space is reused rather than allocated again
+    std::vector<std::unique_ptr<NameSet>> m_spareNames;
+    NameSet &AcquireNames(size_t directoryId, bool caseInsensitive);
+    void ReleaseNames(size_t directoryId);
+
+    // Whether names on each device are looked up case-insensitively, as a mount inside the path can differ from it
+    bool IsCaseInsensitive(const NativeChar *path, uint64_t device);
+    std::unordered_map<uint64_t, bool> m_caseInsensitiveDevices;
+
+    // Directories already walked in this run, by device and inode
+    struct FileId
+    {
+        uint64_t Device;
+        uint64_t Inode;
+
+        bool operator==(FileId const &other) const
+        {
+            return Device == other.Device && Inode == other.Inode;
+        }
+    };
+
+    struct FileIdHash
+    {
+        size_t operator()(FileId const &id) const
+        {
+            return std::hash<uint64_t>()(id.Inode * 0x9e3779b97f4a7c15ull ^ id.Device);
+        }
+    };
+
+    std::unordered_set<FileId, FileIdHash> m_visited;
+
+    // With FixSymlinks, each renamed path's new name by its absolute path before the run, and the symlinks found
+    // along the way, so their targets can be rewritten once every rename is done
+    std::unordered_map<NativeString, NativeString> m_renamedPaths;
+    std::vector<std::filesystem::path> m_symlinks;
+    std::filesystem::path m_currentDirectory;
+
+    // Created the first time a directory is big enough to need it
+    std::unique_ptr<ThreadPool> m_pool;
+
+    static constexpr unsigned MaxPrefetchThreads = 16;
+    bool m_adaptivePrefetch = false; // Read-ahead depth follows the adaptive in-flight window
+    std::unique_ptr<DirectoryPrefetcher> m_prefetcher;
+
+    int m_renames = 0;
+    int m_skipped = 0;
+    int m_truncated = 0;
+    int m_symlinksFixed = 0;
+    uint64_t m_lookupsAvoided = 0;
+    int m_errors = 0;
+    int m_errorCounts[(size_t)ErrorOperation::Count] = {};
+    std::vector<ItemError> m_errorRecords;
+};
+
+} // namespace AsciiRename
+
+#endif
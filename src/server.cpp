@@ -0,0 +1,366 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "helpers.h"
+#include "server.h"
+#include "threadpool.h"
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+#ifndef _WIN32
+
+static const uint32_t MaxFrameLength = 64 * 1024;
+static const size_t FrameHeaderLength = 9;
+
+static volatile sig_atomic_t s_stopRequested = 0;
+
+static void RequestStop(int)
+{
+    s_stopRequested = 1;
+}
+
+struct Connection
+{
+    explicit Connection(int fd) : Fd(fd)
+    {
+    }
+
+    ~Connection()
+    {
+        close(Fd);
+    }
+
+    int Fd;
+    std::mutex WriteLock;
+    std::atomic<bool> Closed{false};
+};
+
+struct ReaderThread
+{
+    std::shared_ptr<Connection> Conn;
+    std::thread Thread;
+};
+
+static uint32_t ReadUInt32(const unsigned char *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void WriteUInt32(unsigned char *data, uint32_t value)
+{
+    data[0] = (unsigned char)value;
+    data[1] = (unsigned char)(value >> 8);
+    data[2] = (unsigned char)(value >> 16);
+    data[3] = (unsigned char)(value >> 24);
+}
+
+static bool ReadFull(int fd, void *buffer, size_t length)
+{
+    auto ptr = (char *)buffer;
+    while (length > 0)
+    {
+        ssize_t result = read(fd, ptr, length);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        ptr += result;
+        length -= result;
+    }
+    return true;
+}
+
+static bool WriteFull(int fd, const void *buffer, size_t length)
+{
+    auto ptr = (const char *)buffer;
+    while (length > 0)
+    {
+        ssize_t result = write(fd, ptr, length);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        ptr += result;
+        length -= result;
+    }
+    return true;
+}
+
+static void SendResponse(Connection &conn, uint32_t id, ServerStatus status, std::string const &payload)
+{
+    auto frame = std::string(FrameHeaderLength + payload.size(), '\0');
+    auto data = (unsigned char *)&frame[0];
+    WriteUInt32(data, (uint32_t)(frame.size() - 4));
+    WriteUInt32(data + 4, id);
+    data[8] = (unsigned char)status;
+    memcpy(data + FrameHeaderLength, payload.data(), payload.size());
+
+    std::lock_guard<std::mutex> lock(conn.WriteLock);
+    WriteFull(conn.Fd, frame.data(), frame.size());
+}
+
+static bool TryRenamePath(RenameOptions const &options, std::string const &pathStr, std::string &result)
+{
+    auto path = std::filesystem::path(pathStr);
+    auto nameStr = path.filename().string();
+
+    auto asciiNameStr = std::string();
+    if (nameStr.empty() || !TryGetAsciiName(nameStr, asciiNameStr) || asciiNameStr.empty())
+    {
+        result = "Unable to convert path to ASCII";
+        return false;
+    }
+
+    auto newPath = path.parent_path() / asciiNameStr;
+    if (asciiNameStr == nameStr || options.NoOp)
+    {
+        result = newPath.string();
+        return true;
+    }
+
+    auto operation = IoOperation();
+    int renameResult = -1;
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    // Check and rename atomically, since other requests may be racing for the same name
+    renameResult =
+        renameat2(AT_FDCWD, path.c_str(), AT_FDCWD, newPath.c_str(), options.Overwrite ? 0 : RENAME_NOREPLACE);
+    if (renameResult != 0 && errno != EINVAL && errno != ENOSYS)
+    {
+        result = strerror(errno);
+        return false;
+    }
+#endif
+
+    if (renameResult != 0)
+    {
+        auto ec = std::error_code();
+        if (!options.Overwrite && std::filesystem::exists(newPath, ec))
+        {
+            result = strerror(EEXIST);
+            return false;
+        }
+
+        if (rename(path.c_str(), newPath.c_str()) != 0)
+        {
+            result = strerror(errno);
+            return false;
+        }
+    }
+
+    result = newPath.string();
+    return true;
+}
+
+static bool TrySetLimits(std::string const &payload, std::string &result)
+{
+    unsigned opsPerSecond = 0;
+    unsigned maxInflight = 0;
+    char extra = 0;
+    if (sscanf(payload.c_str(), "%u %u %c", &opsPerSecond, &maxInflight, &extra) != 2)
+    {
+        result = "Expected \"OPS_PER_SEC MAX_INFLIGHT\"";
+        return false;
+    }
+
+    SetIoLimits({opsPerSecond, maxInflight, GetIoLimits().Adaptive});
+    result = std::to_string(opsPerSecond) + " " + std::to_string(maxInflight);
+    return true;
+}
+
+static void HandleRequest(RenameOptions const &options, Connection &conn, uint32_t id, ServerOp op,
+                          std::string const &payload)
+{
+    auto result = std::string();
+    switch (op)
+    {
+    case ServerOp::Transliterate:
+        if (TryGetAscii(payload, result))
+        {
+            SendResponse(conn, id, ServerStatus::Ok, result);
+        }
+        else
+        {
+            SendResponse(conn, id, ServerStatus::Failed, "Unable to convert text to ASCII");
+        }
+        break;
+    case ServerOp::Rename:
+        if (TryRenamePath(options, payload, result))
+        {
+            SendResponse(conn, id, ServerStatus::Ok, result);
+        }
+        else
+        {
+            SendResponse(conn, id, ServerStatus::Failed, result);
+        }
+        break;
+    case ServerOp::SetLimits:
+        if (TrySetLimits(payload, result))
+        {
+            SendResponse(conn, id, ServerStatus::Ok, result);
+        }
+        else
+        {
+            SendResponse(conn, id, ServerStatus::BadRequest, result);
+        }
+        break;
+    default:
+        SendResponse(conn, id, ServerStatus::BadRequest, "Unknown operation");
+        break;
+    }
+}
+
+static void ReadRequests(RenameOptions const &options, ThreadPool &pool, std::shared_ptr<Connection> conn)
+{
+    unsigned char header[FrameHeaderLength];
+    while (ReadFull(conn->Fd, header, sizeof(header)))
+    {
+        uint32_t length = ReadUInt32(header);
+        uint32_t id = ReadUInt32(header + 4);
+        auto op = (ServerOp)header[8];
+
+        if (length < FrameHeaderLength - 4 || length > MaxFrameLength)
+        {
+            SendResponse(*conn, id, ServerStatus::BadRequest, "Invalid frame length");
+            break;
+        }
+
+        auto payload = std::string(length - (FrameHeaderLength - 4), '\0');
+        if (!payload.empty() && !ReadFull(conn->Fd, &payload[0], payload.size()))
+        {
+            break;
+        }
+
+        pool.Submit([&options, conn, id, op, payload] { HandleRequest(options, *conn, id, op, payload); });
+    }
+
+    conn->Closed = true;
+}
+
+int RunServer(RenameOptions const &options, const char *socketPath)
+{
+    auto address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        std::cerr << "ERROR: Socket path \"" << socketPath << "\" is too long.\n";
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    // Any path a client sends may be renamed, so only the owner may connect, from the moment the socket exists
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t previousMask = umask(0177);
+    bool bound = listenFd >= 0 && bind(listenFd, (sockaddr *)&address, sizeof(address)) == 0;
+    umask(previousMask);
+    if (!bound || chmod(socketPath, 0600) != 0 || listen(listenFd, SOMAXCONN) != 0)
+    {
+        std::cerr << "ERROR: Unable to listen on \"" << socketPath << "\": " << strerror(errno) << ".\n";
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+        }
+        return -1;
+    }
+
+    signal(SIGINT, RequestStop);
+    signal(SIGTERM, RequestStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    auto pool = ThreadPool(options.Jobs);
+    auto readers = std::vector<ReaderThread>();
+
+    if (options.Verbose)
+    {
+        std::cout << "Listening on \"" << socketPath << "\" with " << pool.Size()
+                  << " threads, press Ctrl+C to stop...\n";
+    }
+
+    while (!s_stopRequested)
+    {
+        auto pfd = pollfd{listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) <= 0)
+        {
+            continue;
+        }
+
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        // Reap readers whose clients have gone away
+        for (auto it = readers.begin(); it != readers.end();)
+        {
+            if (it->Conn->Closed)
+            {
+                it->Thread.join();
+                it = readers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        auto conn = std::make_shared<Connection>(fd);
+        readers.push_back({conn, std::thread(ReadRequests, std::cref(options), std::ref(pool), conn)});
+    }
+
+    close(listenFd);
+    unlink(socketPath);
+
+    // Stop reading new requests, then let the pool finish the ones already read
+    for (auto &reader : readers)
+    {
+        shutdown(reader.Conn->Fd, SHUT_RD);
+        reader.Thread.join();
+    }
+    pool.Wait();
+
+    return 0;
+}
+
+#else
+
+int RunServer(RenameOptions const &, const char *)
+{
+    std::cerr << "ERROR: \"--serve\" isn't supported on this platform.\n";
+    return -1;
+}
+
+#endif
+
+} // namespace AsciiRename
@@ -0,0 +1,41 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+
+#include "renamer.h"
+
+namespace AsciiRename
+{
+
+// Request and response frames are little-endian:
+//
+// Request:  uint32 length, uint32 id, uint8 op, payload[length - 5]
+// Response: uint32 length, uint32 id, uint8 status, payload[length - 5]
+//
+// The length doesn't include itself. Requests on a connection may be pipelined, and responses
+// come back in whatever order they finish, so clients should match them up by id.
+
+enum class ServerOp : uint8_t
+{
+    Transliterate = 1, // Payload is UTF-8 text, response payload is its ASCII transliteration
+    Rename = 2,        // Payload is a UTF-8 path, response payload is its new path
+    SetLimits = 3,     // Payload is "OPS_PER_SEC MAX_INFLIGHT" (0 for unlimited), response payload is the same
+};
+
+enum class ServerStatus : uint8_t
+{
+    Ok = 0,
+    Failed = 1,     // Payload is an error message
+    BadRequest = 2, // Payload is an error message
+};
+
+// Serves requests on a Unix domain socket, until interrupted
+int RunServer(RenameOptions const &options, const char *socketPath);
+
+} // namespace AsciiRename
+
+#endif
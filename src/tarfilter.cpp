@@ -0,0 +1,822 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "helpers.h"
+#include "tarfilter.h"
+
+namespace AsciiRename
+{
+
+static const size_t BlockSize = 512;
+static const size_t BufferSize = 1024 * 1024;
+
+// Extended headers are held in memory until their member arrives, so they're limited to keep memory use bounded
+static const uint64_t MaxExtendedHeaderSize = 16 * 1024 * 1024;
+
+// Header fields, by offset and length
+static const size_t NameOffset = 0;
+static const size_t NameLength = 100;
+static const size_t ModeOffset = 100;
+static const size_t UidOffset = 108;
+static const size_t GidOffset = 116;
+static const size_t IdLength = 8;
+static const size_t SizeOffset = 124;
+static const size_t SizeLength = 12;
+static const size_t MTimeOffset = 136;
+static const size_t MTimeLength = 12;
+static const size_t ChecksumOffset = 148;
+static const size_t ChecksumLength = 8;
+static const size_t TypeOffset = 156;
+static const size_t LinkNameOffset = 157;
+static const size_t LinkNameLength = 100;
+static const size_t MagicOffset = 257;
+static const size_t PrefixOffset = 345; // Only in POSIX ustar headers, GNU headers keep other fields here
+static const size_t PrefixLength = 155;
+
+static std::string_view GetField(const char *header, size_t offset, size_t length)
+{
+    auto field = std::string_view(header + offset, length);
+    return field.substr(0, field.find('\0'));
+}
+
+// Fields don't need a NUL when the value fills them
+static void SetField(char *header, size_t offset, size_t length, std::string_view value)
+{
+    memset(header + offset, 0, length);
+    memcpy(header + offset, value.data(), std::min(length, value.size()));
+}
+
+// Numbers are octal, or base-256 with the top bit set when they're too big for octal
+static uint64_t ParseNumber(const char *field, size_t length)
+{
+    uint64_t value = 0;
+    if ((unsigned char)field[0] & 0x80)
+    {
+        value = (unsigned char)field[0] & 0x7f;
+        for (size_t i = 1; i < length; ++i)
+        {
+            value = (value << 8) | (unsigned char)field[i];
+        }
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < length && field[i] == ' ')
+    {
+        ++i;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+    {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+static void SetNumber(char *header, size_t offset, size_t length, uint64_t value)
+{
+    snprintf(header + offset, length, "%0*llo", (int)length - 1, (unsigned long long)value);
+}
+
+// The checksum is the sum of the header's bytes, with the checksum field itself counted as spaces
+static unsigned HeaderSum(const char *header, bool signedBytes)
+{
+    unsigned sum = 0;
+    for (size_t i = 0; i < BlockSize; ++i)
+    {
+        if (i >= ChecksumOffset && i < ChecksumOffset + ChecksumLength)
+        {
+            sum += ' ';
+        }
+        else
+        {
+            sum += signedBytes ? (unsigned)(int)(signed char)header[i] : (unsigned char)header[i];
+        }
+    }
+    return sum;
+}
+
+static bool IsChecksumValid(const char *header)
+{
+    // Some old tars summed signed bytes
+    auto expected = (unsigned)ParseNumber(header + ChecksumOffset, ChecksumLength);
+    return expected == HeaderSum(header, false) || expected == HeaderSum(header, true);
+}
+
+static void SetChecksum(char *header)
+{
+    snprintf(header + ChecksumOffset, ChecksumLength, "%06o", HeaderSum(header, false));
+    header[ChecksumOffset + ChecksumLength - 1] = ' ';
+}
+
+static bool IsPosixUstar(const char *header)
+{
+    return memcmp(header + MagicOffset, "ustar\0", 6) == 0;
+}
+
+static bool IsZeroBlock(const char *header)
+{
+    return std::all_of(header, header + BlockSize, [](char c) { return c == 0; });
+}
+
+// Links, devices, directories and FIFOs have no data, whatever their size says
+static bool HasData(char type)
+{
+    return type == '\0' || strchr("123456", type) == nullptr;
+}
+
+static uint64_t PaddedSize(uint64_t size)
+{
+    return (size + BlockSize - 1) / BlockSize * BlockSize;
+}
+
+static std::string GetUstarPath(const char *header)
+{
+    auto name = GetField(header, NameOffset, NameLength);
+    auto prefix = IsPosixUstar(header) ? GetField(header, PrefixOffset, PrefixLength) : std::string_view();
+    if (prefix.empty())
+    {
+        return std::string(name);
+    }
+    return std::string(prefix) + "/" + std::string(name);
+}
+
+// Stores path in the name (and for POSIX ustar, prefix) fields, returning false if it had to be cut short to fit
+static bool SetUstarPath(char *header, std::string_view path)
+{
+    bool posix = IsPosixUstar(header);
+    if (posix)
+    {
+        SetField(header, PrefixOffset, PrefixLength, std::string_view());
+    }
+
+    if (path.size() <= NameLength)
+    {
+        SetField(header, NameOffset, NameLength, path);
+        return true;
+    }
+
+    if (posix)
+    {
+        // Split at the first separator that leaves a short enough name
+        size_t split = path.find('/', path.size() - NameLength - 1);
+        if (split != std::string_view::npos && split > 0 && split <= PrefixLength && split + 1 < path.size())
+        {
+            SetField(header, PrefixOffset, PrefixLength, path.substr(0, split));
+            SetField(header, NameOffset, NameLength, path.substr(split + 1));
+            return true;
+        }
+    }
+
+    SetField(header, NameOffset, NameLength, path);
+    return false;
+}
+
+// Calls visit(key, value) for each "LENGTH KEY=VALUE\n" record, returning false if data is malformed
+template <typename Visit> static bool ForEachPaxRecord(std::string_view data, Visit visit)
+{
+    while (!data.empty())
+    {
+        size_t space = data.find(' ');
+        size_t length = 0;
+        for (size_t i = 0; i < space && i < data.size(); ++i)
+        {
+            if (data[i] < '0' || data[i] > '9')
+            {
+                return false;
+            }
+            length = length * 10 + (data[i] - '0');
+        }
+
+        if (space == std::string_view::npos || length <= space + 1 || length > data.size() || data[length - 1] != '\n')
+        {
+            return false;
+        }
+
+        auto record = data.substr(space + 1, length - space - 2);
+        size_t equals = record.find('=');
+        if (equals == std::string_view::npos)
+        {
+            return false;
+        }
+
+        visit(record.substr(0, equals), record.substr(equals + 1));
+        data.remove_prefix(length);
+    }
+    return true;
+}
+
+static void AppendPaxRecord(std::string &data, std::string_view key, std::string_view value)
+{
+    // The length counts its own digits
+    size_t length = key.size() + value.size() + 3;
+    size_t digits = std::to_string(length).size();
+    length += digits;
+    if (std::to_string(length).size() != digits)
+    {
+        ++length;
+    }
+
+    data += std::to_string(length);
+    data += ' ';
+    data.append(key);
+    data += '=';
+    data.append(value);
+    data += '\n';
+}
+
+// Replaces the values of the path and linkpath records (when given), keeping every other record as it was
+static bool RewritePaxRecords(std::string &data, std::string const *path, std::string const *linkPath)
+{
+    auto rewritten = std::string();
+    bool valid = ForEachPaxRecord(data, [&](std::string_view key, std::string_view value) {
+        if (key == "path" && path != nullptr)
+        {
+            value = *path;
+        }
+        else if (key == "linkpath" && linkPath != nullptr)
+        {
+            value = *linkPath;
+        }
+        AppendPaxRecord(rewritten, key, value);
+    });
+
+    if (valid)
+    {
+        data.swap(rewritten);
+    }
+    return valid;
+}
+
+TarFilter::TarFilter(RenameOptions const &options, int input, int output)
+    : m_options(options), m_input(input), m_output(output), m_buffer(new char[BufferSize])
+{
+#ifdef _WIN32
+    _setmode(input, _O_BINARY);
+    _setmode(output, _O_BINARY);
+#endif
+}
+
+size_t TarFilter::Read(char *buffer, size_t length)
+{
+    size_t total = 0;
+    while (total < length)
+    {
+#ifdef _WIN32
+        auto result = _read(m_input, buffer + total, (unsigned)std::min(length - total, BufferSize));
+#else
+        auto result = read(m_input, buffer + total, length - total);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+#endif
+        if (result <= 0)
+        {
+            break;
+        }
+        total += result;
+    }
+    return total;
+}
+
+bool TarFilter::WriteFull(const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        auto result = _write(m_output, buffer, (unsigned)std::min(length, BufferSize));
+#else
+        auto result = write(m_output, buffer, length);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+#endif
+        if (result <= 0)
+        {
+            std::cerr << "ERROR: Unable to write the tar stream: " << strerror(errno) << ".\n";
+            return false;
+        }
+        buffer += result;
+        length -= result;
+    }
+    return true;
+}
+
+bool TarFilter::CopyData(uint64_t length)
+{
+    if (!TryCopyData(length))
+    {
+        std::cerr << "ERROR: Unable to copy member data, the tar stream may have ended early.\n";
+        return false;
+    }
+    return true;
+}
+
+bool TarFilter::SkipData(uint64_t length)
+{
+    while (length > 0)
+    {
+        auto chunk = (size_t)std::min<uint64_t>(length, BufferSize);
+        if (Read(m_buffer.get(), chunk) != chunk)
+        {
+            std::cerr << "ERROR: Unable to skip member data, the tar stream may have ended early.\n";
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+bool TarFilter::TryCopyData(uint64_t length)
+{
+#ifdef __linux__
+    // When either side is a pipe, the data can move between them without being copied into this process
+    while (length > 0 && m_canSplice)
+    {
+        auto chunk = (size_t)std::min<uint64_t>(length, 1 << 30);
+        ssize_t result = splice(m_input, nullptr, m_output, nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            m_canSplice = false;
+            break;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        length -= result;
+    }
+
+    // Likewise between two files
+    while (length > 0 && m_canCopyRange)
+    {
+        auto chunk = (size_t)std::min<uint64_t>(length, 1 << 30);
+        ssize_t result = copy_file_range(m_input, nullptr, m_output, nullptr, chunk, 0);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0 && (errno == EINVAL || errno == EXDEV || errno == ENOSYS || errno == EBADF ||
+                           errno == EOPNOTSUPP))
+        {
+            m_canCopyRange = false;
+            break;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        length -= result;
+    }
+#endif
+
+    while (length > 0)
+    {
+        auto chunk = (size_t)std::min<uint64_t>(length, BufferSize);
+        if (Read(m_buffer.get(), chunk) != chunk || !WriteFull(m_buffer.get(), chunk))
+        {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+void TarFilter::RecordError(ErrorOperation operation)
+{
+    ++m_errors;
+    ++m_errorCounts[(size_t)operation];
+    ++m_skipped;
+}
+
+// Drops leading "./" and trailing separators, so different spellings of a member's path match
+static std::string_view TrimPath(std::string_view path)
+{
+    while (path.size() > 2 && path.substr(0, 2) == "./")
+    {
+        path.remove_prefix(2);
+    }
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.remove_suffix(1);
+    }
+    return path;
+}
+
+// Puts back whatever TrimPath dropped from original around a mapped path
+static std::string Untrim(std::string_view original, std::string_view trimmed, std::string_view mapped)
+{
+    size_t lead = trimmed.data() - original.data();
+    size_t tail = original.size() - lead - trimmed.size();
+    return std::string(original.substr(0, lead)) + std::string(mapped) +
+           std::string(original.substr(lead + trimmed.size(), tail));
+}
+
+std::string TarFilter::PathKey(std::string_view path) const
+{
+    auto key = std::string(TrimPath(path));
+    if (m_options.Case == CaseSensitivity::Insensitive)
+    {
+        for (auto &c : key)
+        {
+            c = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        }
+    }
+    return key;
+}
+
+std::string const &TarFilter::MapTrimmedPath(std::string_view path, bool member)
+{
+    auto key = PathKey(path);
+    auto mapped = m_mapped.find(key);
+    if (mapped != m_mapped.end())
+    {
+        // Repeated members, and directories already mapped for earlier members inside them
+        return mapped->second;
+    }
+
+    // Members go wherever their directory went, whether it was renamed or kept its name, even when the directory
+    // itself isn't in the archive
+    size_t slash = path.rfind('/');
+    auto name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    auto parent = std::string();
+    if (slash == 0)
+    {
+        parent = "/";
+    }
+    else if (slash != std::string_view::npos)
+    {
+        parent = MapTrimmedPath(TrimPath(path.substr(0, slash)), false);
+        if (parent.empty())
+        {
+            std::cerr << "ERROR: Skipping \"" << path << "\", its directory was left out of the archive.\n";
+            if (member)
+            {
+                RecordError(ErrorOperation::Collision);
+            }
+            return m_mapped.emplace(std::move(key), std::string()).first->second;
+        }
+        parent += '/';
+    }
+
+    auto newName = std::string();
+    if (!TryGetAsciiName(name, newName))
+    {
+        std::cerr << "ERROR: Unable to convert \"" << path << "\" to ASCII, keeping its name.\n";
+        if (member)
+        {
+            RecordError(ErrorOperation::Convert);
+        }
+        newName = name;
+    }
+
+    auto hash = std::hash<std::string>()(key);
+    auto newPath = parent + newName;
+    auto claimed = m_paths.emplace(PathKey(newPath), hash);
+    if (!claimed.second && claimed.first->second != hash && newName != name)
+    {
+        // Another member already has the new name, so this one keeps its own
+        std::cerr << "ERROR: \"" << newPath << "\" is already in the archive, keeping \"" << name << "\".\n";
+        if (member)
+        {
+            RecordError(ErrorOperation::Collision);
+        }
+        newPath = parent + std::string(name);
+        claimed = m_paths.emplace(PathKey(newPath), hash);
+    }
+
+    if (!claimed.second && claimed.first->second != hash)
+    {
+        // An earlier member was already renamed to this one's name, and it's too late to change that one, so this one
+        // is told apart by a hash of its path instead of being left out
+        AddHashSuffix(newName, key);
+        newPath = parent + newName;
+        claimed = m_paths.emplace(PathKey(newPath), hash);
+        if (claimed.second || claimed.first->second == hash)
+        {
+            std::cerr << "WARNING: \"" << parent << name << "\" is already in the archive, renamed from another "
+                      << "member, renaming \"" << path << "\" to \"" << newPath << "\".\n";
+        }
+        else
+        {
+            std::cerr << "ERROR: \"" << newPath << "\" is already in the archive, skipping \"" << path << "\".\n";
+            if (member)
+            {
+                RecordError(ErrorOperation::Collision);
+            }
+            newPath.clear();
+        }
+    }
+
+    return m_mapped.emplace(std::move(key), std::move(newPath)).first->second;
+}
+
+std::string TarFilter::MapPath(std::string_view path)
+{
+    auto trimmed = TrimPath(path);
+    auto const &mapped = MapTrimmedPath(trimmed, true);
+    if (mapped.empty())
+    {
+        return std::string();
+    }
+
+    if (mapped != trimmed)
+    {
+        if (m_options.Verbose)
+        {
+            std::cerr << "Renaming \"" << path << "\" to \"" << mapped << "\"...\n";
+        }
+        ++m_renames;
+    }
+    return Untrim(path, trimmed, mapped);
+}
+
+std::string TarFilter::MapHardLinkTarget(std::string_view path)
+{
+    // Hard links name an earlier member, so they follow whatever it was renamed to
+    auto trimmed = TrimPath(path);
+    auto mapped = m_mapped.find(PathKey(trimmed));
+    if (mapped != m_mapped.end())
+    {
+        return mapped->second.empty() ? std::string(path) : Untrim(path, trimmed, mapped->second);
+    }
+
+    auto newPath = std::string();
+    if (!TryGetAsciiPath(path, newPath))
+    {
+        return std::string(path);
+    }
+    return newPath;
+}
+
+bool TarFilter::WriteHeader(char *header, std::string_view data)
+{
+    SetNumber(header, SizeOffset, SizeLength, data.size());
+    SetChecksum(header);
+
+    static const char Padding[BlockSize] = {};
+    return WriteFull(header, BlockSize) && WriteFull(data.data(), data.size()) &&
+           WriteFull(Padding, PaddedSize(data.size()) - data.size());
+}
+
+bool TarFilter::ProcessMember(char *header)
+{
+    char type = header[TypeOffset];
+    uint64_t size = ParseNumber(header + SizeOffset, SizeLength);
+
+    // Extended headers take precedence over the member's own fields
+    auto path = GetUstarPath(header);
+    auto linkPath = std::string(GetField(header, LinkNameOffset, LinkNameLength));
+    PendingHeader *pax = nullptr;
+    bool extendedPath = false;
+    bool extendedLink = false;
+
+    for (auto &pending : m_pending)
+    {
+        char pendingType = pending.Header[TypeOffset];
+        auto data = std::string_view(pending.Data);
+        if (pendingType == 'L' || pendingType == 'K')
+        {
+            (pendingType == 'L' ? path : linkPath) = data.substr(0, data.find('\0'));
+            (pendingType == 'L' ? extendedPath : extendedLink) = true;
+            continue;
+        }
+
+        pax = &pending;
+        bool valid = ForEachPaxRecord(data, [&](std::string_view key, std::string_view value) {
+            if (key == "path")
+            {
+                path = value;
+                extendedPath = true;
+            }
+            else if (key == "linkpath")
+            {
+                linkPath = value;
+                extendedLink = true;
+            }
+            else if (key == "size")
+            {
+                size = strtoull(std::string(value).c_str(), nullptr, 10);
+            }
+        });
+
+        if (!valid)
+        {
+            std::cerr << "ERROR: Invalid pax header before \"" << path << "\".\n";
+            return false;
+        }
+    }
+
+    ++m_members;
+    auto newPath = MapPath(path);
+    if (newPath.empty())
+    {
+        // Left out rather than written with a name another member already has
+        m_pending.clear();
+        return !HasData(type) || SkipData(PaddedSize(size));
+    }
+    auto newLinkPath = linkPath;
+    if (type == '1')
+    {
+        newLinkPath = MapHardLinkTarget(linkPath);
+    }
+    else if (type == '2' && !TryGetAsciiPath(linkPath, newLinkPath))
+    {
+        std::cerr << "ERROR: Unable convert the target of \"" << path << "\" to ASCII, keeping it.\n";
+        RecordError(ErrorOperation::Convert);
+        newLinkPath = linkPath;
+    }
+
+    bool pathFits = SetUstarPath(header, newPath);
+    bool linkFits = newLinkPath.size() <= LinkNameLength;
+    SetField(header, LinkNameOffset, LinkNameLength, newLinkPath);
+
+    // Names which have grown too long for the header, and aren't already in an extended header, need a pax one
+    bool addPath = !pathFits && !extendedPath;
+    bool addLink = !linkFits && !extendedLink;
+    if ((addPath || addLink) && pax == nullptr)
+    {
+        auto created = PendingHeader();
+        memset(created.Header, 0, BlockSize);
+        SetField(created.Header, ModeOffset, IdLength, "0000644");
+        SetField(created.Header, UidOffset, IdLength, "0000000");
+        SetField(created.Header, GidOffset, IdLength, "0000000");
+        memcpy(created.Header + MTimeOffset, header + MTimeOffset, MTimeLength);
+        created.Header[TypeOffset] = 'x';
+        memcpy(created.Header + MagicOffset, "ustar\0" "00", 8);
+        SetField(created.Header, NameOffset, NameLength, "PaxHeader/" + newPath.substr(newPath.rfind('/') + 1));
+        m_pending.push_back(std::move(created));
+        pax = &m_pending.back();
+    }
+
+    auto headerName = std::string();
+    for (auto &pending : m_pending)
+    {
+        char pendingType = pending.Header[TypeOffset];
+        if (pendingType == 'L' || pendingType == 'K')
+        {
+            pending.Data = (pendingType == 'L' ? newPath : newLinkPath) + '\0';
+        }
+        else
+        {
+            RewritePaxRecords(pending.Data, &newPath, &newLinkPath);
+            if (&pending == pax && addPath)
+            {
+                AppendPaxRecord(pending.Data, "path", newPath);
+            }
+            if (&pending == pax && addLink)
+            {
+                AppendPaxRecord(pending.Data, "linkpath", newLinkPath);
+            }
+        }
+
+        // Readers ignore extended headers' own names, but they shouldn't be left as the only non-ASCII ones
+        if (TryGetAsciiPath(GetUstarPath(pending.Header), headerName))
+        {
+            SetUstarPath(pending.Header, headerName);
+        }
+
+        if (!WriteHeader(pending.Header, pending.Data))
+        {
+            return false;
+        }
+    }
+    m_pending.clear();
+
+    SetChecksum(header);
+    return WriteFull(header, BlockSize) && (!HasData(type) || CopyData(PaddedSize(size)));
+}
+
+bool TarFilter::Run()
+{
+    char header[BlockSize];
+    while (true)
+    {
+        size_t length = Read(header, BlockSize);
+        if (length == 0 && m_pending.empty())
+        {
+            // Ended without the usual zero blocks, which is still readable
+            return true;
+        }
+        if (length != BlockSize)
+        {
+            std::cerr << "ERROR: Unexpected end of the tar stream.\n";
+            return false;
+        }
+
+        if (IsZeroBlock(header))
+        {
+            // The end of the archive, after which everything is passed through as it is
+            if (!WriteFull(header, BlockSize))
+            {
+                return false;
+            }
+            while ((length = Read(m_buffer.get(), BufferSize)) > 0)
+            {
+                if (!WriteFull(m_buffer.get(), length))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        if (!IsChecksumValid(header))
+        {
+            std::cerr << "ERROR: Invalid tar header, the input may not be a tar archive.\n";
+            return false;
+        }
+
+        char type = header[TypeOffset];
+        if (type == 'x' || type == 'g' || type == 'L' || type == 'K')
+        {
+            uint64_t size = ParseNumber(header + SizeOffset, SizeLength);
+            if (size > MaxExtendedHeaderSize)
+            {
+                std::cerr << "ERROR: Extended tar header is too large.\n";
+                return false;
+            }
+
+            auto pending = PendingHeader();
+            memcpy(pending.Header, header, BlockSize);
+            pending.Data.resize(PaddedSize(size));
+            if (Read(&pending.Data[0], pending.Data.size()) != pending.Data.size())
+            {
+                std::cerr << "ERROR: Unexpected end of the tar stream.\n";
+                return false;
+            }
+            pending.Data.resize(size);
+
+            if (type != 'g')
+            {
+                // Held until the member it describes
+                m_pending.push_back(std::move(pending));
+                continue;
+            }
+
+            // Global headers apply to every member after them, so names in them are converted without being claimed
+            auto path = std::string();
+            auto linkPath = std::string();
+            bool valid = ForEachPaxRecord(pending.Data, [&](std::string_view key, std::string_view value) {
+                if (key == "path" && !TryGetAsciiPath(value, path))
+                {
+                    path = value;
+                }
+                else if (key == "linkpath" && !TryGetAsciiPath(value, linkPath))
+                {
+                    linkPath = value;
+                }
+            });
+
+            if (!valid || !RewritePaxRecords(pending.Data, &path, &linkPath))
+            {
+                std::cerr << "ERROR: Invalid pax global header.\n";
+                return false;
+            }
+
+            if (!WriteHeader(pending.Header, pending.Data))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (!ProcessMember(header))
+        {
+            return false;
+        }
+    }
+}
+
+void TarFilter::PrintSummary() const
+{
+    std::cerr << "Members: " << m_members << ", Renamed: " << m_renames << ", Skipped: " << m_skipped << "\n";
+
+    if (m_errors > 0)
+    {
+        std::cerr << "Errors: " << m_errors << " (Convert: " << m_errorCounts[(size_t)ErrorOperation::Convert]
+                  << ", Collision: " << m_errorCounts[(size_t)ErrorOperation::Collision] << ")\n";
+    }
+}
+
+} // namespace AsciiRename
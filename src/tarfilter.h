@@ -0,0 +1,95 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef TARFILTER_H
+#define TARFILTER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "renamer.h"
+
+namespace AsciiRename
+{
+
+// Copies a tar stream from one file descriptor to another, rewriting member names and link targets into ASCII.
+// Handles ustar, pax (x and g) and GNU (L and K) headers. Member data is passed through without being parsed, with
+// splice or copy_file_range where the OS supports them, so memory use doesn't grow with the size of the archive.
+class TarFilter
+{
+  public:
+    TarFilter(RenameOptions const &options, int input, int output);
+
+    // Returns false if the input isn't a valid tar stream, or it couldn't be read or written
+    bool Run();
+
+    int Renames() const
+    {
+        return m_renames;
+    }
+
+    int Skipped() const
+    {
+        return m_skipped;
+    }
+
+    // Written to stderr, since stdout is usually the archive
+    void PrintSummary() const;
+
+  private:
+    // An extended header (pax x, GNU L or K) waiting for the member it describes
+    struct PendingHeader
+    {
+        char Header[512];
+        std::string Data;
+    };
+
+    bool ProcessMember(char *header);
+    bool WriteHeader(char *header, std::string_view data);
+
+    // The path a member is renamed to, under wherever its directory went. Its name is kept if the new one would
+    // collide with another member, and if even that's taken, a hash of its path is added to the new one. It's only
+    // empty, for a member that has to be left out, if that's taken too.
+    std::string MapPath(std::string_view path);
+    std::string const &MapTrimmedPath(std::string_view path, bool member);
+    std::string MapHardLinkTarget(std::string_view path);
+    std::string PathKey(std::string_view path) const;
+
+    // Returns how much was read, which is only short at the end of the input or on an error
+    size_t Read(char *buffer, size_t length);
+    bool WriteFull(const char *buffer, size_t length);
+    bool CopyData(uint64_t length);
+    bool SkipData(uint64_t length);
+    bool TryCopyData(uint64_t length);
+
+    void RecordError(ErrorOperation operation);
+
+    RenameOptions m_options;
+    int m_input;
+    int m_output;
+    std::vector<PendingHeader> m_pending;
+    std::unique_ptr<char[]> m_buffer;
+    bool m_canSplice = true;
+    bool m_canCopyRange = true;
+
+    // Every member's new path, by the hash of the path it came from, to tell collisions from repeated members
+    std::unordered_map<std::string, size_t> m_paths;
+
+    // Where each member and directory went, by its original path, or empty if it was left out. Later members inside
+    // a directory, and hard links to a member, follow it.
+    std::unordered_map<std::string, std::string> m_mapped;
+
+    int m_members = 0;
+    int m_renames = 0;
+    int m_skipped = 0;
+    int m_errors = 0;
+    int m_errorCounts[(size_t)ErrorOperation::Count] = {};
+};
+
+} // namespace AsciiRename
+
+#endif
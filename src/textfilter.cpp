@@ -0,0 +1,256 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "composition.h"
+#include "helpers.h"
+#include "mappedfile.h"
+#include "textfilter.h"
+
+namespace AsciiRename
+{
+
+static const size_t ChunkSize = 1024 * 1024;
+
+// How far back from a chunk's end to look for a newline before settling for any character boundary
+static const size_t NewlineSearchLength = 64 * 1024;
+
+// Ends a chunk just after a newline if there's one near the end, so override sequences are never split, or otherwise
+// just before the last character that nothing earlier composes with, so decomposed marks stay with their base
+// character. Returns start if the whole chunk has to wait for more input.
+static size_t FindChunkEnd(const char *data, size_t start, size_t end)
+{
+    size_t limit = end - std::min(end - start, NewlineSearchLength);
+    for (size_t i = end; i > limit; --i)
+    {
+        if (data[i - 1] == '\n')
+        {
+            return i;
+        }
+    }
+
+    size_t incomplete = end;
+    for (size_t i = end; i > limit; --i)
+    {
+        auto c = (unsigned char)data[i - 1];
+        if ((c & 0xc0) == 0x80)
+        {
+            continue;
+        }
+
+        size_t offset = i - 1;
+        size_t length = c < 0x80 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : 2;
+        if (offset + length > end)
+        {
+            incomplete = offset;
+            continue;
+        }
+
+        uint32_t codePoint = c < 0x80 ? c : c & (0x7f >> length);
+        for (size_t j = 1; j < length; ++j)
+        {
+            codePoint = (codePoint << 6) | ((unsigned char)data[offset + j] & 0x3f);
+        }
+
+        if (offset > start && GetCompositionProperty(codePoint) == 0)
+        {
+            return offset;
+        }
+    }
+
+    // A short chunk with nothing to split before waits for the next batch whole, while one with marks as far back as
+    // was searched is split anyway, keeping only a partial character back
+    return limit == start ? start : incomplete;
+}
+
+TextFilter::TextFilter(RenameOptions const &options, int output) : m_options(options), m_output(output)
+{
+#ifdef _WIN32
+    _setmode(output, _O_BINARY);
+#endif
+
+    if (m_options.Jobs != 1)
+    {
+        m_pool = std::make_unique<ThreadPool>(m_options.Jobs);
+    }
+    m_threads = m_pool ? m_pool->Size() : 1;
+}
+
+size_t TextFilter::ProcessBatch(const char *data, size_t length, bool final)
+{
+    auto chunks = std::vector<std::string_view>();
+    for (size_t start = 0; start < length;)
+    {
+        size_t end = std::min(start + ChunkSize, length);
+        if (end < length || !final)
+        {
+            end = FindChunkEnd(data, start, end);
+            if (end == start)
+            {
+                break;
+            }
+        }
+        chunks.emplace_back(data + start, end - start);
+        start = end;
+    }
+
+    if (m_chunks.size() < chunks.size())
+    {
+        m_chunks.resize(chunks.size());
+    }
+
+    auto results = std::vector<char>(chunks.size());
+    auto convert = [&](size_t i) {
+        m_chunks[i].reserve(chunks[i].size());
+        results[i] = TryGetAscii(chunks[i], m_chunks[i]);
+    };
+
+    if (chunks.size() == 1 || !m_pool)
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            convert(i);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            m_pool->Submit([&convert, i] { convert(i); });
+        }
+        m_pool->Wait();
+    }
+
+    size_t consumed = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if (!results[i])
+        {
+            std::cerr << "ERROR: Unable to convert text to ASCII.\n";
+            m_failed = true;
+            return consumed;
+        }
+
+        if (!WriteFull(m_chunks[i].data(), m_chunks[i].size()))
+        {
+            m_failed = true;
+            return consumed;
+        }
+        consumed += chunks[i].size();
+    }
+    return consumed;
+}
+
+bool TextFilter::Run(int input)
+{
+#ifdef _WIN32
+    _setmode(input, _O_BINARY);
+#endif
+
+    // Enough for every thread to have a couple of chunks, with whatever was left over from the last batch at the start
+    size_t batchSize = ChunkSize * m_threads * 2;
+    auto buffer = std::unique_ptr<char[]>(new char[batchSize]);
+    size_t pending = 0;
+    bool final = false;
+
+    while (!final && !m_failed)
+    {
+        size_t length = pending;
+        while (length < batchSize)
+        {
+#ifdef _WIN32
+            auto result = _read(input, buffer.get() + length, (unsigned)std::min(batchSize - length, ChunkSize));
+#else
+            auto result = read(input, buffer.get() + length, batchSize - length);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+#endif
+            if (result < 0)
+            {
+                std::cerr << "ERROR: Unable to read the text: " << strerror(errno) << ".\n";
+                return false;
+            }
+            if (result == 0)
+            {
+                final = true;
+                break;
+            }
+            length += result;
+        }
+        m_bytesRead += length - pending;
+
+        size_t consumed = ProcessBatch(buffer.get(), length, final);
+        pending = length - consumed;
+        memmove(buffer.get(), buffer.get() + consumed, pending);
+    }
+
+    return !m_failed;
+}
+
+bool TextFilter::Run(std::filesystem::path const &input)
+{
+    auto file = MappedFile();
+    if (!file.Open(input))
+    {
+        std::cerr << "ERROR: Unable to read \"" << input.u8string() << "\", skipping.\n";
+        ++m_skipped;
+        return !m_failed;
+    }
+
+    size_t batchSize = ChunkSize * m_threads * 2;
+    for (size_t offset = 0; offset < file.Size() && !m_failed;)
+    {
+        size_t length = std::min(batchSize, file.Size() - offset);
+        size_t consumed = ProcessBatch(file.Data() + offset, length, offset + length == file.Size());
+        m_bytesRead += consumed;
+        offset += consumed;
+    }
+
+    return !m_failed;
+}
+
+bool TextFilter::WriteFull(const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        auto result = _write(m_output, buffer, (unsigned)std::min(length, ChunkSize));
+#else
+        auto result = write(m_output, buffer, length);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+#endif
+        if (result <= 0)
+        {
+            std::cerr << "ERROR: Unable to write the text: " << strerror(errno) << ".\n";
+            return false;
+        }
+        buffer += result;
+        length -= result;
+        m_bytesWritten += result;
+    }
+    return true;
+}
+
+void TextFilter::PrintSummary() const
+{
+    std::cerr << "Read: " << m_bytesRead << " bytes, Written: " << m_bytesWritten << " bytes, Skipped: " << m_skipped
+              << "\n";
+}
+
+} // namespace AsciiRename
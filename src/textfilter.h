@@ -0,0 +1,59 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef TEXTFILTER_H
+#define TEXTFILTER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renamer.h"
+#include "threadpool.h"
+
+namespace AsciiRename
+{
+
+// Transliterates text into ASCII with the same mapping used for names, but without any of the filename rules. Input is
+// split into chunks at line or character boundaries, which are converted in parallel and written out in order.
+class TextFilter
+{
+  public:
+    TextFilter(RenameOptions const &options, int output);
+
+    // Reads the file descriptor until it ends
+    bool Run(int input);
+
+    // Maps the whole file rather than reading it
+    bool Run(std::filesystem::path const &input);
+
+    int Skipped() const
+    {
+        return m_skipped;
+    }
+
+    // Written to stderr, since stdout is usually the text
+    void PrintSummary() const;
+
+  private:
+    // Converts and writes everything up to the last boundary in data, returning how much was consumed
+    size_t ProcessBatch(const char *data, size_t length, bool final);
+    bool WriteFull(const char *buffer, size_t length);
+
+    RenameOptions m_options;
+    int m_output;
+    std::unique_ptr<ThreadPool> m_pool;
+    size_t m_threads;
+    std::vector<std::string> m_chunks;
+    bool m_failed = false;
+
+    uint64_t m_bytesRead = 0;
+    uint64_t m_bytesWritten = 0;
+    int m_skipped = 0;
+};
+
+} // namespace AsciiRename
+
+#endif
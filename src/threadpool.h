@@ -0,0 +1,52 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AsciiRename
+{
+
+// A fixed set of worker threads running queued tasks in FIFO order
+class ThreadPool
+{
+  public:
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished
+    void Wait();
+
+    unsigned Size() const
+    {
+        return (unsigned)m_threads.size();
+    }
+
+  private:
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void WorkerLoop();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_idle;
+    size_t m_active = 0;
+    bool m_stopping = false;
+};
+
+} // namespace AsciiRename
+
+#endif
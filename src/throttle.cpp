@@ -0,0 +1,242 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <thread>
+
+#include "throttle.h"
+
+namespace AsciiRename
+{
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<bool> s_enabled(false);
+static std::mutex s_mutex;
+static std::condition_variable s_slotFree;
+static IoLimits s_limits = {0, 0, false};
+static double s_tokens = 0;
+static Clock::time_point s_lastRefill;
+static unsigned s_inflight = 0;
+
+// Additive-increase/multiplicative-decrease window, like TCP congestion control: grows by one slot per window's
+// worth of operations while latency stays near the fastest seen, and halves (at most once per window) when
+// latency climbs past twice that, which means the file system is queueing rather than serving in parallel
+static const uint64_t LatencySlackNanos = 50 * 1000;
+static double s_window = 2;
+static unsigned s_largestWindow = 2;
+static uint64_t s_decreases = 0;
+static uint64_t s_minLatency = UINT64_MAX;
+static double s_latencyAverage = 0;
+static double s_completionsSinceDecrease = 0;
+
+static std::atomic<uint64_t> s_waits(0);
+static std::atomic<uint64_t> s_waitNanoseconds(0);
+
+// Adjustments requested by signals, applied by the next operation since handlers can't take locks
+static volatile sig_atomic_t s_slowerRequests = 0;
+static volatile sig_atomic_t s_fasterRequests = 0;
+
+// Up to a tenth of a second's worth of operations can happen at once after being idle
+static double Burst(unsigned opsPerSecond)
+{
+    return std::max(1.0, opsPerSecond / 10.0);
+}
+
+static void ApplyLimits(IoLimits const &limits)
+{
+    s_limits = limits;
+    s_tokens = std::min(s_tokens, Burst(limits.OpsPerSecond));
+    s_lastRefill = Clock::now();
+    s_enabled = limits.OpsPerSecond > 0 || limits.MaxInflight > 0 || limits.Adaptive;
+    s_slotFree.notify_all();
+}
+
+void SetIoLimits(IoLimits const &limits)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    ApplyLimits(limits);
+}
+
+IoLimits GetIoLimits()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_limits;
+}
+
+#ifdef SIGUSR1
+static void RequestSlower(int)
+{
+    s_slowerRequests = s_slowerRequests + 1;
+}
+
+static void RequestFaster(int)
+{
+    s_fasterRequests = s_fasterRequests + 1;
+}
+#endif
+
+void InstallIoLimitSignals()
+{
+#ifdef SIGUSR1
+    signal(SIGUSR1, RequestSlower);
+    signal(SIGUSR2, RequestFaster);
+#endif
+}
+
+ThrottleCounters GetThrottleCounters()
+{
+    return {s_waits.load(std::memory_order_relaxed), s_waitNanoseconds.load(std::memory_order_relaxed)};
+}
+
+AdaptiveWindowStats GetAdaptiveWindowStats()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return {(unsigned)s_window, s_largestWindow, s_decreases, s_minLatency == UINT64_MAX ? 0 : s_minLatency};
+}
+
+// Called with s_mutex held
+static unsigned InflightLimit()
+{
+    if (!s_limits.Adaptive)
+    {
+        return s_limits.MaxInflight;
+    }
+    return (unsigned)s_window;
+}
+
+// Called with s_mutex held
+static void RecordLatency(uint64_t latency)
+{
+    double cap = s_limits.MaxInflight > 0 ? s_limits.MaxInflight : MaxAdaptiveWindow;
+
+    s_minLatency = std::min(s_minLatency, std::max<uint64_t>(latency, 1));
+    s_latencyAverage = s_latencyAverage == 0 ? latency : s_latencyAverage * 0.9 + latency * 0.1;
+    s_completionsSinceDecrease += 1;
+
+    // Cached operations take a few microseconds, where doubling is noise rather than queueing
+    if (s_latencyAverage > 2.0 * s_minLatency && s_latencyAverage > s_minLatency + LatencySlackNanos)
+    {
+        if (s_completionsSinceDecrease >= s_window && s_window > 1)
+        {
+            s_window = std::max(1.0, s_window / 2);
+            s_completionsSinceDecrease = 0;
+            s_latencyAverage = 0;
+            ++s_decreases;
+        }
+    }
+    else
+    {
+        s_window = std::min(cap, s_window + 1 / s_window);
+    }
+
+    s_largestWindow = std::max(s_largestWindow, (unsigned)s_window);
+    s_slotFree.notify_all();
+}
+
+// Called with s_mutex held
+static void ApplySignalRequests()
+{
+    int slower = s_slowerRequests;
+    int faster = s_fasterRequests;
+    if ((slower == 0 && faster == 0) || s_limits.OpsPerSecond == 0)
+    {
+        return;
+    }
+    s_slowerRequests = s_slowerRequests - slower;
+    s_fasterRequests = s_fasterRequests - faster;
+
+    auto limits = s_limits;
+    double rate = limits.OpsPerSecond;
+    for (; slower > 0; --slower)
+    {
+        rate = std::max(1.0, rate / 2);
+    }
+    for (; faster > 0; --faster)
+    {
+        rate = std::min(1e9, rate * 2);
+    }
+    limits.OpsPerSecond = (unsigned)rate;
+    ApplyLimits(limits);
+}
+
+IoOperation::IoOperation() : m_holdsSlot(false)
+{
+    if (!s_enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    auto start = Clock::now();
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+    ApplySignalRequests();
+
+    while (s_limits.OpsPerSecond > 0)
+    {
+        auto now = Clock::now();
+        auto elapsed = std::chrono::duration<double>(now - s_lastRefill).count();
+        s_tokens = std::min(Burst(s_limits.OpsPerSecond), s_tokens + elapsed * s_limits.OpsPerSecond);
+        s_lastRefill = now;
+
+        if (s_tokens >= 1)
+        {
+            s_tokens -= 1;
+            break;
+        }
+
+        // Sleep until the next token, without blocking other threads from checking
+        auto wait = std::chrono::duration<double>((1 - s_tokens) / s_limits.OpsPerSecond);
+        waited = true;
+        lock.unlock();
+        std::this_thread::sleep_for(wait);
+        lock.lock();
+        ApplySignalRequests();
+    }
+
+    if (InflightLimit() > 0)
+    {
+        if (s_inflight >= InflightLimit())
+        {
+            waited = true;
+            s_slotFree.wait(lock, [] { return InflightLimit() == 0 || s_inflight < InflightLimit(); });
+        }
+        ++s_inflight;
+        m_holdsSlot = true;
+    }
+
+    m_start = Clock::now();
+    if (waited)
+    {
+        s_waits.fetch_add(1, std::memory_order_relaxed);
+        s_waitNanoseconds.fetch_add(
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - start).count(),
+            std::memory_order_relaxed);
+    }
+}
+
+IoOperation::~IoOperation()
+{
+    if (m_holdsSlot)
+    {
+        // Only time spent in the operation itself counts, not waiting for a turn
+        auto latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count();
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            --s_inflight;
+            if (s_limits.Adaptive)
+            {
+                RecordLatency(latency);
+            }
+        }
+        s_slotFree.notify_one();
+    }
+}
+
+} // namespace AsciiRename
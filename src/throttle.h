@@ -0,0 +1,65 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace AsciiRename
+{
+
+// Limits on file system operations across all threads. Zero means unlimited, which is the default.
+struct IoLimits
+{
+    unsigned OpsPerSecond;
+    unsigned MaxInflight;
+    bool Adaptive; // Find the best in-flight window from latency, up to MaxInflight (or MaxAdaptiveWindow)
+};
+
+static const unsigned MaxAdaptiveWindow = 256;
+
+void SetIoLimits(IoLimits const &limits);
+IoLimits GetIoLimits();
+
+// Lets SIGUSR1 halve and SIGUSR2 double the ops per second while running (POSIX only)
+void InstallIoLimitSignals();
+
+struct ThrottleCounters
+{
+    uint64_t Waits;           // Operations which had to wait for a token or a free slot
+    uint64_t WaitNanoseconds; // Total time spent waiting
+};
+
+ThrottleCounters GetThrottleCounters();
+
+struct AdaptiveWindowStats
+{
+    unsigned Window;          // Current in-flight window
+    unsigned LargestWindow;   // Largest window reached
+    uint64_t Decreases;       // Times the window was cut because latency rose
+    uint64_t MinLatencyNanos; // Fastest operation seen, which latency is judged against
+};
+
+AdaptiveWindowStats GetAdaptiveWindowStats();
+
+// Held for the duration of a single file system operation. Waits for a token from the bucket and a free
+// in-flight slot when limits are set, and costs an atomic load when they aren't.
+class IoOperation
+{
+  public:
+    IoOperation();
+    ~IoOperation();
+
+  private:
+    IoOperation(const IoOperation &) = delete;
+    IoOperation &operator=(const IoOperation &) = delete;
+
+    bool m_holdsSlot;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace AsciiRename
+
+#endif
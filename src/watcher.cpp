@@ -0,0 +1,426 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "helpers.h"
+#include "metadata.h"
+#include "watcher.h"
+
+namespace AsciiRename
+{
+
+#ifdef __linux__
+
+// How long to wait for more events before processing a batch
+static const int BatchDelayMs = 100;
+static const auto MaxBatchAge = std::chrono::seconds(1);
+static const size_t MaxBatchSize = 4096;
+
+static const uint32_t WatchMask = IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR;
+
+static volatile sig_atomic_t s_stopRequested = 0;
+
+static bool IsPathUnder(std::string const &path, std::string const &prefix)
+{
+    return path.compare(0, prefix.size(), prefix) == 0 && (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+static bool ReplacePathPrefix(std::string &path, std::string const &oldPrefix, std::string const &newPrefix)
+{
+    if (!IsPathUnder(path, oldPrefix))
+    {
+        return false;
+    }
+
+    path = newPrefix + path.substr(oldPrefix.size());
+    return true;
+}
+
+static void RequestStop(int)
+{
+    s_stopRequested = 1;
+}
+
+class Watcher
+{
+  public:
+    Watcher(RenameOptions const &options) : m_options(options), m_renamer(options)
+    {
+        m_renamer.SetRenamedCallback(
+            [this](std::filesystem::path const &oldPath, std::filesystem::path const &newPath) {
+                OnRenamed(oldPath, newPath);
+            });
+    }
+
+    ~Watcher()
+    {
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    int Run(std::vector<std::filesystem::path::string_type> const &paths);
+
+  private:
+    struct WatchedDirectory
+    {
+        std::filesystem::path Path;
+        int Depth;
+        uint64_t RootDevice;
+    };
+
+    struct PendingEntry
+    {
+        std::filesystem::path Path;
+        int Depth;
+        uint64_t RootDevice;
+    };
+
+    bool AddWatch(std::filesystem::path const &path, int depth, uint64_t rootDevice);
+    void AddWatchTree(std::filesystem::path const &path, int depth, uint64_t rootDevice);
+    void RemoveWatchTree(std::filesystem::path const &path);
+
+    bool CanDescend(int depth) const
+    {
+        return m_options.MaxDepth < 0 || depth < m_options.MaxDepth;
+    }
+
+    void ReadEvents();
+    void QueueEntry(std::filesystem::path const &path, int depth, uint64_t rootDevice);
+    void QueueAllEntries();
+    void ProcessBatch();
+
+    void OnRenamed(std::filesystem::path const &oldPath, std::filesystem::path const &newPath);
+
+    RenameOptions m_options;
+    Renamer m_renamer;
+    int m_fd = -1;
+
+    std::unordered_map<int, WatchedDirectory> m_watches;
+
+    std::vector<PendingEntry> m_pending;
+    std::unordered_set<std::string> m_pendingPaths;
+    std::chrono::steady_clock::time_point m_batchStart;
+
+    // New paths of our own renames, so the resulting events can be ignored
+    std::unordered_set<std::string> m_ownRenames;
+};
+
+int Watcher::Run(std::vector<std::filesystem::path::string_type> const &paths)
+{
+    m_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (m_fd < 0)
+    {
+        std::cerr << "ERROR: Unable to initialize inotify: " << strerror(errno) << ".\n";
+        return -1;
+    }
+
+    for (auto rawPath : paths)
+    {
+        TrimTrailingPathSeparator(rawPath);
+        auto path = std::filesystem::path(rawPath);
+
+        auto info = FileInfo();
+        auto ec = std::error_code();
+        if (!TryGetFileInfo(path.c_str(), info, ec) || !info.IsDirectory)
+        {
+            std::cerr << "ERROR: \"" << rawPath << "\" isn't a directory.\n";
+            return -1;
+        }
+
+        if (m_options.Recursive)
+        {
+            AddWatchTree(path, 0, info.Device);
+        }
+        else if (!AddWatch(path, 0, info.Device))
+        {
+            return -1;
+        }
+    }
+
+    signal(SIGINT, RequestStop);
+    signal(SIGTERM, RequestStop);
+
+    if (m_options.Verbose)
+    {
+        std::cout << "Watching " << m_watches.size() << " directories, press Ctrl+C to stop...\n";
+    }
+
+    while (!s_stopRequested)
+    {
+        auto pfd = pollfd{m_fd, POLLIN, 0};
+        int result = poll(&pfd, 1, m_pending.empty() ? -1 : BatchDelayMs);
+
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "ERROR: Unable to wait for file system events: " << strerror(errno) << ".\n";
+            return -1;
+        }
+
+        if (result > 0)
+        {
+            ReadEvents();
+        }
+
+        // Coalesce events until things go quiet, the batch is big enough or it's waited long enough
+        if (!m_pending.empty() && (result == 0 || m_pending.size() >= MaxBatchSize ||
+                                   std::chrono::steady_clock::now() - m_batchStart >= MaxBatchAge))
+        {
+            ProcessBatch();
+        }
+    }
+
+    ProcessBatch();
+
+    if (m_options.Verbose)
+    {
+        m_renamer.PrintSummary();
+    }
+
+    return 0;
+}
+
+bool Watcher::AddWatch(std::filesystem::path const &path, int depth, uint64_t rootDevice)
+{
+    int wd = inotify_add_watch(m_fd, path.c_str(), WatchMask);
+    if (wd < 0)
+    {
+        std::cerr << "ERROR: Unable to watch \"" << path.string() << "\": " << strerror(errno) << ".\n";
+        return false;
+    }
+
+    m_watches[wd] = {path, depth, rootDevice};
+    return true;
+}
+
+void Watcher::AddWatchTree(std::filesystem::path const &path, int depth, uint64_t rootDevice)
+{
+    if (!AddWatch(path, depth, rootDevice) || !CanDescend(depth))
+    {
+        return;
+    }
+
+    auto ec = std::error_code();
+    auto it = std::filesystem::recursive_directory_iterator(
+        path, std::filesystem::directory_options::skip_permission_denied, ec);
+
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_directory(ec) || it->is_symlink(ec))
+        {
+            continue;
+        }
+
+        int childDepth = depth + it.depth() + 1;
+        auto info = FileInfo();
+        auto infoEc = std::error_code();
+        if (m_options.OneFileSystem && (!TryGetFileInfo(it->path().c_str(), info, infoEc) || info.Device != rootDevice))
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        if (!AddWatch(it->path(), childDepth, rootDevice) || !CanDescend(childDepth))
+        {
+            it.disable_recursion_pending();
+        }
+    }
+}
+
+void Watcher::RemoveWatchTree(std::filesystem::path const &path)
+{
+    for (auto it = m_watches.begin(); it != m_watches.end();)
+    {
+        if (IsPathUnder(it->second.Path.native(), path.native()))
+        {
+            inotify_rm_watch(m_fd, it->first);
+            it = m_watches.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Watcher::ReadEvents()
+{
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (true)
+    {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            return;
+        }
+
+        for (char *ptr = buffer; ptr < buffer + length;)
+        {
+            auto event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                std::cerr << "WARNING: Too many file system events, rescanning watched directories...\n";
+                QueueAllEntries();
+                continue;
+            }
+
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end())
+            {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                m_watches.erase(watch);
+                continue;
+            }
+
+            if (event->len == 0)
+            {
+                continue;
+            }
+
+            auto path = watch->second.Path / event->name;
+
+            if (event->mask & IN_MOVED_FROM)
+            {
+                RemoveWatchTree(path);
+            }
+            else
+            {
+                QueueEntry(path, watch->second.Depth + 1, watch->second.RootDevice);
+            }
+        }
+    }
+}
+
+void Watcher::QueueEntry(std::filesystem::path const &path, int depth, uint64_t rootDevice)
+{
+    if (m_pendingPaths.insert(path.native()).second)
+    {
+        if (m_pending.empty())
+        {
+            m_batchStart = std::chrono::steady_clock::now();
+        }
+        m_pending.push_back({path, depth, rootDevice});
+    }
+}
+
+void Watcher::QueueAllEntries()
+{
+    for (auto const &watch : m_watches)
+    {
+        auto ec = std::error_code();
+        for (auto it = std::filesystem::directory_iterator(watch.second.Path, ec);
+             !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+        {
+            QueueEntry(it->path(), watch.second.Depth + 1, watch.second.RootDevice);
+        }
+    }
+}
+
+void Watcher::ProcessBatch()
+{
+    auto pending = std::move(m_pending);
+    m_pending.clear();
+    m_pendingPaths.clear();
+
+    for (auto const &entry : pending)
+    {
+        if (m_ownRenames.erase(entry.Path.native()) > 0)
+        {
+            // Event was caused by one of our renames
+            continue;
+        }
+
+        auto info = FileInfo();
+        auto ec = std::error_code();
+        if (!TryGetFileInfo(entry.Path.c_str(), info, ec))
+        {
+            // Already gone
+            continue;
+        }
+
+        if (info.IsDirectory && m_options.Recursive && CanDescend(entry.Depth) &&
+            (!m_options.OneFileSystem || info.Device == entry.RootDevice))
+        {
+            // Watch first so nothing added while renaming is missed, the watched paths follow our renames
+            AddWatchTree(entry.Path, entry.Depth, entry.RootDevice);
+        }
+
+        m_renamer.AddPath(entry.Path.native(), entry.Depth, entry.RootDevice);
+        m_renamer.ProcessPaths();
+    }
+}
+
+void Watcher::OnRenamed(std::filesystem::path const &oldPath, std::filesystem::path const &newPath)
+{
+    for (auto &watch : m_watches)
+    {
+        auto watched = watch.second.Path.native();
+        if (ReplacePathPrefix(watched, oldPath.native(), newPath.native()))
+        {
+            watch.second.Path = watched;
+        }
+    }
+
+    // Earlier renames under a renamed directory will report events under its new path
+    auto ownRenames = std::vector<std::string>();
+    for (auto it = m_ownRenames.begin(); it != m_ownRenames.end();)
+    {
+        auto ownRename = *it;
+        if (ReplacePathPrefix(ownRename, oldPath.native(), newPath.native()))
+        {
+            ownRenames.push_back(ownRename);
+            it = m_ownRenames.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    m_ownRenames.insert(ownRenames.begin(), ownRenames.end());
+    m_ownRenames.insert(newPath.native());
+}
+
+int RunWatch(RenameOptions const &options, std::vector<std::filesystem::path::string_type> const &paths)
+{
+    auto watcher = Watcher(options);
+    return watcher.Run(paths);
+}
+
+#else
+
+int RunWatch(RenameOptions const &, std::vector<std::filesystem::path::string_type> const &)
+{
+    std::cerr << "ERROR: \"--watch\" isn't supported on this platform.\n";
+    return -1;
+}
+
+#endif
+
+} // namespace AsciiRename
@@ -0,0 +1,20 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <filesystem>
+#include <vector>
+
+#include "renamer.h"
+
+namespace AsciiRename
+{
+
+// Watches the given directories and renames new entries as they appear, until interrupted
+int RunWatch(RenameOptions const &options, std::vector<std::filesystem::path::string_type> const &paths);
+
+} // namespace AsciiRename
+
+#endif
@@ -0,0 +1,503 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "helpers.h"
+#include "mappedfile.h"
+#include "nativepath.h"
+#include "ziprewriter.h"
+
+namespace AsciiRename
+{
+
+static const uint32_t LocalHeaderSignature = 0x04034b50;
+static const uint32_t CentralHeaderSignature = 0x02014b50;
+static const uint32_t EndSignature = 0x06054b50;
+static const uint32_t Zip64LocatorSignature = 0x07064b50;
+
+static const size_t LocalHeaderLength = 30;
+static const size_t CentralHeaderLength = 46;
+static const size_t EndLength = 22;
+static const size_t Zip64LocatorLength = 20;
+
+static const uint16_t Utf8Flag = 0x0800;           // General purpose flag bit 11, names are UTF-8
+static const uint16_t UnicodePathExtraId = 0x7075; // Info-ZIP's UTF-8 copy of the name
+
+static uint16_t ReadUInt16(const char *data)
+{
+    auto bytes = (const unsigned char *)data;
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t ReadUInt32(const char *data)
+{
+    auto bytes = (const unsigned char *)data;
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void WriteUInt16(char *data, uint16_t value)
+{
+    data[0] = (char)value;
+    data[1] = (char)(value >> 8);
+}
+
+static void WriteUInt32(char *data, uint32_t value)
+{
+    data[0] = (char)value;
+    data[1] = (char)(value >> 8);
+    data[2] = (char)(value >> 16);
+    data[3] = (char)(value >> 24);
+}
+
+static uint32_t Crc32(std::string_view data)
+{
+    uint32_t crc = 0xffffffff;
+    for (unsigned char c : data)
+    {
+        crc ^= c;
+        for (int i = 0; i < 8; ++i)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static bool IsValidUtf8(std::string_view data)
+{
+    for (size_t i = 0; i < data.size();)
+    {
+        auto c = (unsigned char)data[i];
+        size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 0;
+        if (length == 0 || i + length > data.size())
+        {
+            return false;
+        }
+        for (size_t j = 1; j < length; ++j)
+        {
+            if (((unsigned char)data[i + j] >> 6) != 0x2)
+            {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+// Calls visit(id, data) for each block in an extra field, returning false if it's malformed
+template <typename Visit> static bool ForEachExtraBlock(std::string_view extra, Visit visit)
+{
+    while (extra.size() >= 4)
+    {
+        uint16_t id = ReadUInt16(extra.data());
+        uint16_t length = ReadUInt16(extra.data() + 2);
+        if (4 + (size_t)length > extra.size())
+        {
+            return false;
+        }
+        visit(id, extra.substr(0, 4 + length));
+        extra.remove_prefix(4 + length);
+    }
+    return extra.empty();
+}
+
+// The UTF-8 name from a Unicode Path extra block, if there is one and it still matches the header's name
+static bool TryGetUnicodePath(std::string_view extra, std::string_view name, std::string_view &unicodeName)
+{
+    bool found = false;
+    ForEachExtraBlock(extra, [&](uint16_t id, std::string_view block) {
+        if (id == UnicodePathExtraId && block.size() >= 9 && block[4] == 1 &&
+            ReadUInt32(block.data() + 5) == Crc32(name))
+        {
+            unicodeName = block.substr(9);
+            found = true;
+        }
+    });
+    return found;
+}
+
+// Once the name is rewritten, readers would prefer a Unicode Path block over it, so it has to go
+static std::string WithoutUnicodePath(std::string_view extra)
+{
+    auto result = std::string();
+    bool valid = ForEachExtraBlock(extra, [&](uint16_t id, std::string_view block) {
+        if (id != UnicodePathExtraId)
+        {
+            result.append(block);
+        }
+    });
+    return valid ? result : std::string(extra);
+}
+
+ZipRewriter::ZipRewriter(RenameOptions const &options) : m_options(options)
+{
+}
+
+void ZipRewriter::RecordError(ErrorOperation operation)
+{
+    ++m_errors;
+    ++m_errorCounts[(size_t)operation];
+    ++m_skipped;
+}
+
+bool ZipRewriter::Rewrite(std::filesystem::path const &input, std::filesystem::path const &output)
+{
+    auto inputStr = input.u8string();
+    auto fail = [&](const char *message) {
+        std::cerr << "ERROR: Unable to rewrite \"" << inputStr << "\": " << message << ".\n";
+        ++m_skipped;
+        return false;
+    };
+
+    auto file = MappedFile();
+    if (!file.Open(input))
+    {
+        return fail("can't read the file");
+    }
+    const char *data = file.Data();
+    size_t size = file.Size();
+
+    // The end record is at the end of the file, followed by a comment of up to 64 KiB and sometimes block padding
+    size_t end = SIZE_MAX;
+    for (size_t i = size >= EndLength ? size - EndLength + 1 : 0; i > 0 && size - (i - 1) <= EndLength + 0xffff; --i)
+    {
+        if (ReadUInt32(data + i - 1) == EndSignature && i - 1 + EndLength + ReadUInt16(data + i - 1 + 20) <= size)
+        {
+            end = i - 1;
+            break;
+        }
+    }
+
+    if (end == SIZE_MAX)
+    {
+        return fail("not a ZIP archive");
+    }
+
+    uint16_t disk = ReadUInt16(data + end + 4);
+    uint16_t directoryDisk = ReadUInt16(data + end + 6);
+    uint16_t diskEntries = ReadUInt16(data + end + 8);
+    uint16_t entryCount = ReadUInt16(data + end + 10);
+    uint32_t directorySize = ReadUInt32(data + end + 12);
+    uint32_t directoryOffset = ReadUInt32(data + end + 16);
+
+    if (entryCount == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff ||
+        (end >= Zip64LocatorLength && ReadUInt32(data + end - Zip64LocatorLength) == Zip64LocatorSignature))
+    {
+        return fail("ZIP64 archives aren't supported");
+    }
+
+    if (disk != 0 || directoryDisk != 0 || diskEntries != entryCount)
+    {
+        return fail("split archives aren't supported");
+    }
+
+    if ((uint64_t)directoryOffset + directorySize > end)
+    {
+        return fail("the central directory is corrupt");
+    }
+
+    struct Entry
+    {
+        size_t Central;        // Offset of the central directory header
+        uint32_t LocalOffset;  // Offset of the local header, as found in the input
+        std::string_view Name; // The name as UTF-8, or empty if it couldn't be read
+        std::string NewName;   // Empty unless renamed
+    };
+
+    auto entries = std::vector<Entry>();
+    auto newName = std::string();
+
+    for (size_t offset = directoryOffset, i = 0; i < entryCount; ++i)
+    {
+        const char *header = data + offset;
+        if (offset + CentralHeaderLength > (size_t)directoryOffset + directorySize ||
+            ReadUInt32(header) != CentralHeaderSignature)
+        {
+            return fail("the central directory is corrupt");
+        }
+
+        uint16_t flags = ReadUInt16(header + 8);
+        uint32_t compressedSize = ReadUInt32(header + 20);
+        uint32_t uncompressedSize = ReadUInt32(header + 24);
+        uint16_t nameLength = ReadUInt16(header + 28);
+        uint16_t extraLength = ReadUInt16(header + 30);
+        uint16_t commentLength = ReadUInt16(header + 32);
+        uint32_t localOffset = ReadUInt32(header + 42);
+
+        size_t next = offset + CentralHeaderLength + nameLength + extraLength + commentLength;
+        if (next > (size_t)directoryOffset + directorySize || localOffset >= directoryOffset)
+        {
+            return fail("the central directory is corrupt");
+        }
+
+        if (compressedSize == 0xffffffff || uncompressedSize == 0xffffffff || localOffset == 0xffffffff)
+        {
+            return fail("ZIP64 archives aren't supported");
+        }
+
+        auto name = std::string_view(header + CentralHeaderLength, nameLength);
+        auto extra = std::string_view(header + CentralHeaderLength + nameLength, extraLength);
+        entries.push_back({offset, localOffset, std::string_view(), std::string()});
+        offset = next;
+
+        // Names are UTF-8 when flagged or given in a Unicode Path block, and otherwise in whatever code page the
+        // archiver used, which can only be trusted when it happens to be valid UTF-8
+        auto utf8Name = std::string_view();
+        if (!TryGetUnicodePath(extra, name, utf8Name))
+        {
+            utf8Name = name;
+            if (!(flags & Utf8Flag) && !IsValidUtf8(name))
+            {
+                std::cerr << "ERROR: Unable to read the name of an entry in \"" << inputStr << "\", skipping.\n";
+                RecordError(ErrorOperation::Convert);
+                continue;
+            }
+        }
+
+        if (!TryGetAsciiPath(utf8Name, newName))
+        {
+            std::cerr << "ERROR: Unable to convert entry \"" << utf8Name << "\" to ASCII, skipping.\n";
+            RecordError(ErrorOperation::Convert);
+            continue;
+        }
+
+        entries.back().Name = utf8Name;
+        if (newName != name)
+        {
+            entries.back().NewName = newName;
+        }
+    }
+
+    auto keyOf = [&](std::string_view path) {
+        auto key = std::string(path);
+        if (m_options.Case == CaseSensitivity::Insensitive)
+        {
+            std::transform(key.begin(), key.end(), key.begin(), [](char c) {
+                return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+            });
+        }
+        return key;
+    };
+
+    // Entries keeping their names claim them first, so a renamed entry never takes a name that's already there
+    auto names = std::unordered_map<std::string, std::string_view>();
+    for (auto const &entry : entries)
+    {
+        if (entry.NewName.empty())
+        {
+            auto const *header = data + entry.Central;
+            names.emplace(keyOf(std::string_view(header + CentralHeaderLength, ReadUInt16(header + 28))), entry.Name);
+        }
+    }
+
+    for (auto &entry : entries)
+    {
+        if (entry.NewName.empty())
+        {
+            continue;
+        }
+
+        // Two entries may share a name (an archive can be appended to), but two different names can't become one
+        auto existing = names.emplace(keyOf(entry.NewName), entry.Name);
+        if (!existing.second && existing.first->second != entry.Name)
+        {
+            std::cerr << "ERROR: \"" << entry.NewName << "\" is already in \"" << inputStr << "\", skipping \""
+                      << entry.Name << "\".\n";
+            RecordError(ErrorOperation::Collision);
+            entry.NewName.clear();
+            continue;
+        }
+
+        if (m_options.NoOp || m_options.Verbose)
+        {
+            std::cout << (m_options.NoOp ? "Would have renamed \"" : "Renaming \"") << entry.Name << "\" to \""
+                      << entry.NewName << "\" in \"" << inputStr << "\"...\n";
+        }
+        ++m_renames;
+    }
+
+    ++m_archives;
+
+    bool anyRenamed = std::any_of(entries.begin(), entries.end(), [](Entry const &e) { return !e.NewName.empty(); });
+    if (m_options.NoOp || (!anyRenamed && output.empty()))
+    {
+        return true;
+    }
+
+    // Entries are written in the order they're stored, with everything between them (including data descriptors
+    // and anything before the first one) copied as it is
+    auto order = std::vector<Entry *>();
+    for (auto &entry : entries)
+    {
+        order.push_back(&entry);
+    }
+    std::sort(order.begin(), order.end(),
+              [](Entry const *a, Entry const *b) { return a->LocalOffset < b->LocalOffset; });
+
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        if (order[i]->LocalOffset == order[i - 1]->LocalOffset)
+        {
+            return fail("entries overlap");
+        }
+    }
+
+    auto target = output.empty() ? input : output;
+    auto tempPath = std::filesystem::path();
+    auto tempError = std::error_code();
+    if (!TryCreateTempFile(target, tempPath, tempError))
+    {
+        return fail("can't create a temporary file next to it");
+    }
+
+    auto newOffsets = std::unordered_map<const Entry *, uint32_t>();
+    {
+        auto stream = std::ofstream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!stream)
+        {
+            std::filesystem::remove(tempPath, tempError);
+            return fail("can't create a temporary file next to it");
+        }
+
+        uint64_t written = 0;
+        auto write = [&](const char *bytes, size_t length) {
+            stream.write(bytes, length);
+            written += length;
+        };
+
+        size_t first = order.empty() ? directoryOffset : order.front()->LocalOffset;
+        write(data, first);
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            auto const &entry = *order[i];
+            size_t offset = entry.LocalOffset;
+            size_t spanEnd = i + 1 < order.size() ? order[i + 1]->LocalOffset : directoryOffset;
+            if (offset + LocalHeaderLength > spanEnd || ReadUInt32(data + offset) != LocalHeaderSignature)
+            {
+                stream.close();
+                std::filesystem::remove(tempPath);
+                return fail("a local header is corrupt");
+            }
+
+            uint16_t nameLength = ReadUInt16(data + offset + 26);
+            uint16_t extraLength = ReadUInt16(data + offset + 28);
+            size_t dataStart = offset + LocalHeaderLength + nameLength + extraLength;
+            if (dataStart > spanEnd || written > 0xfffffffe)
+            {
+                stream.close();
+                std::filesystem::remove(tempPath);
+                return fail(written > 0xfffffffe ? "it would need ZIP64" : "a local header is corrupt");
+            }
+
+            newOffsets[&entry] = (uint32_t)written;
+            if (entry.NewName.empty())
+            {
+                write(data + offset, spanEnd - offset);
+                continue;
+            }
+
+            char header[LocalHeaderLength];
+            memcpy(header, data + offset, LocalHeaderLength);
+            auto extra =
+                WithoutUnicodePath(std::string_view(data + offset + LocalHeaderLength + nameLength, extraLength));
+            WriteUInt16(header + 6, ReadUInt16(header + 6) & ~Utf8Flag);
+            WriteUInt16(header + 26, (uint16_t)entry.NewName.size());
+            WriteUInt16(header + 28, (uint16_t)extra.size());
+
+            write(header, LocalHeaderLength);
+            write(entry.NewName.data(), entry.NewName.size());
+            write(extra.data(), extra.size());
+            write(data + dataStart, spanEnd - dataStart);
+        }
+
+        uint64_t newDirectoryOffset = written;
+        for (auto const &entry : entries)
+        {
+            const char *original = data + entry.Central;
+            uint16_t nameLength = ReadUInt16(original + 28);
+            uint16_t extraLength = ReadUInt16(original + 30);
+            uint16_t commentLength = ReadUInt16(original + 32);
+            auto name = std::string_view(original + CentralHeaderLength, nameLength);
+            auto extra = std::string_view(original + CentralHeaderLength + nameLength, extraLength);
+            auto comment = std::string_view(original + CentralHeaderLength + nameLength + extraLength, commentLength);
+
+            auto newExtra = std::string(extra);
+            char header[CentralHeaderLength];
+            memcpy(header, original, CentralHeaderLength);
+            if (!entry.NewName.empty())
+            {
+                name = entry.NewName;
+                newExtra = WithoutUnicodePath(extra);
+                WriteUInt16(header + 8, ReadUInt16(header + 8) & ~Utf8Flag);
+                WriteUInt16(header + 28, (uint16_t)name.size());
+                WriteUInt16(header + 30, (uint16_t)newExtra.size());
+            }
+            WriteUInt32(header + 42, newOffsets[&entry]);
+
+            write(header, CentralHeaderLength);
+            write(name.data(), name.size());
+            write(newExtra.data(), newExtra.size());
+            write(comment.data(), comment.size());
+        }
+
+        uint64_t newDirectorySize = written - newDirectoryOffset;
+        if (written > 0xffffffff)
+        {
+            stream.close();
+            std::filesystem::remove(tempPath);
+            return fail("it would need ZIP64");
+        }
+
+        // Anything between the central directory and the end record, like a digital signature, is kept too
+        write(data + directoryOffset + directorySize, end - directoryOffset - directorySize);
+
+        char endRecord[EndLength];
+        memcpy(endRecord, data + end, EndLength);
+        WriteUInt32(endRecord + 12, (uint32_t)newDirectorySize);
+        WriteUInt32(endRecord + 16, (uint32_t)newDirectoryOffset);
+        write(endRecord, EndLength);
+        write(data + end + EndLength, size - end - EndLength);
+
+        if (!stream)
+        {
+            stream.close();
+            std::filesystem::remove(tempPath);
+            return fail("can't write the rewritten archive");
+        }
+    }
+
+    file.Close();
+
+    auto ec = std::error_code();
+    std::filesystem::permissions(tempPath, std::filesystem::status(input, ec).permissions(), ec);
+    std::filesystem::rename(tempPath, target, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return fail("can't replace it with the rewritten archive");
+    }
+
+    return true;
+}
+
+void ZipRewriter::PrintSummary() const
+{
+    std::cout << "Archives: " << m_archives << ", Renamed: " << m_renames << ", Skipped: " << m_skipped << "\n";
+
+    if (m_errors > 0)
+    {
+        std::cout << "Errors: " << m_errors << " (Convert: " << m_errorCounts[(size_t)ErrorOperation::Convert]
+                  << ", Collision: " << m_errorCounts[(size_t)ErrorOperation::Collision] << ")\n";
+    }
+}
+
+} // namespace AsciiRename
@@ -0,0 +1,51 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#ifndef ZIPREWRITER_H
+#define ZIPREWRITER_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "renamer.h"
+
+namespace AsciiRename
+{
+
+// Rewrites the entry names in ZIP archives into ASCII, in both the local headers and the central directory. Entry
+// data is copied byte for byte, never decompressed, so rewriting costs about as much as copying the file.
+class ZipRewriter
+{
+  public:
+    explicit ZipRewriter(RenameOptions const &options);
+
+    // Writes the rewritten archive to output, or replaces input with it when output is empty
+    bool Rewrite(std::filesystem::path const &input, std::filesystem::path const &output);
+
+    int Renames() const
+    {
+        return m_renames;
+    }
+
+    int Skipped() const
+    {
+        return m_skipped;
+    }
+
+    void PrintSummary() const;
+
+  private:
+    void RecordError(ErrorOperation operation);
+
+    RenameOptions m_options;
+    int m_archives = 0;
+    int m_renames = 0;
+    int m_skipped = 0;
+    int m_errors = 0;
+    int m_errorCounts[(size_t)ErrorOperation::Count] = {};
+};
+
+} // namespace AsciiRename
+
+#endif
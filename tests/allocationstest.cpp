@@ -0,0 +1,173 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+// Walks generated trees with the Renamer, counting heap allocations, to check that once its buffers have grown an
+// item costs none: a walk of a tree with more items in the same directories has to make exactly as many. That's
+// checked both when only planning the renames with --no-op and when actually making them.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "renamer.h"
+
+using namespace AsciiRename;
+
+static std::atomic<size_t> s_allocations(0);
+
+void *operator new(size_t size)
+{
+    ++s_allocations;
+    if (void *p = malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static const int DirectoryCount = 8;
+
+// Every file needs renaming, so each item goes through transliteration and the collision check
+static void CreateTree(std::filesystem::path const &root, int filesPerDirectory)
+{
+    for (int d = 0; d < DirectoryCount; ++d)
+    {
+        auto directory = root / std::filesystem::u8path("d\xc3\xafr" + std::to_string(d));
+        std::filesystem::create_directories(directory);
+        for (int f = 0; f < filesPerDirectory; ++f)
+        {
+            std::ofstream(directory / std::filesystem::u8path("f\xc3\xafl\xc3\xa9" + std::to_string(f) + ".txt"));
+        }
+    }
+}
+
+struct WalkResult
+{
+    size_t Allocations;
+    double Seconds;
+};
+
+static WalkResult Walk(Renamer &renamer, std::filesystem::path const &root)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t before = s_allocations;
+
+    renamer.AddPath(root.native());
+    renamer.ProcessPaths();
+
+    size_t allocations = s_allocations - before;
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {allocations, elapsed};
+}
+
+// A walk that makes the renames leaves the tree renamed, so it's put back the way it was before the next one
+static WalkResult WalkFresh(Renamer &renamer, std::filesystem::path const &root, int filesPerDirectory, bool noOp)
+{
+    if (!noOp || !std::filesystem::exists(root))
+    {
+        auto ec = std::error_code();
+        std::filesystem::remove_all(root, ec);
+        CreateTree(root, filesPerDirectory);
+    }
+    return Walk(renamer, root);
+}
+
+static bool CheckWalks(std::filesystem::path const &base, bool noOp)
+{
+    const int SmallFiles = 250;
+    const int LargeFiles = 2000;
+
+    auto small = base / "small";
+    auto large = base / "large";
+
+    auto options = RenameOptions();
+    options.NoOp = noOp;
+    options.Recursive = true;
+    options.Jobs = 1;
+    auto renamer = Renamer(options);
+
+    // Each rename is announced on stdout, which only gets in the way here
+    auto output = std::cout.rdbuf(nullptr);
+
+    // The first walk grows the buffers to fit the bigger tree
+    WalkFresh(renamer, large, LargeFiles, noOp);
+    auto smallResult = WalkFresh(renamer, small, SmallFiles, noOp);
+    auto largeResult = WalkFresh(renamer, large, LargeFiles, noOp);
+
+    std::cout.rdbuf(output);
+    std::cout.clear();
+
+    auto mode = std::string(noOp ? "Planned" : "Renamed");
+    size_t smallItems = DirectoryCount * (SmallFiles + 1) + 1;
+    size_t largeItems = DirectoryCount * (LargeFiles + 1) + 1;
+    std::cout << mode << " small tree: " << smallItems << " items, " << smallResult.Allocations << " allocations, "
+              << smallResult.Seconds * 1e9 / smallItems << " ns per item\n";
+    std::cout << mode << " large tree: " << largeItems << " items, " << largeResult.Allocations << " allocations, "
+              << largeResult.Seconds * 1e9 / largeItems << " ns per item\n";
+
+    // Every directory and file is renamed, in each of the three walks
+    int expectedRenames = DirectoryCount * (2 * (LargeFiles + 1) + SmallFiles + 1);
+    if (renamer.Renames() != expectedRenames || renamer.Errors() != 0)
+    {
+        std::cerr << "FAILED: " << mode << " walks didn't make the expected renames.\n";
+        return false;
+    }
+
+    if (!noOp && !std::filesystem::exists(large / "dir0" / "file0.txt"))
+    {
+        std::cerr << "FAILED: The files weren't renamed on disk.\n";
+        return false;
+    }
+
+    if (largeResult.Allocations != smallResult.Allocations)
+    {
+        std::cerr << "FAILED: " << mode << " walks made " << largeResult.Allocations - smallResult.Allocations
+                  << " more allocations for " << largeItems - smallItems << " more items.\n";
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto base = std::filesystem::temp_directory_path() / ("ascii-rename-allocations-" + std::to_string(stamp));
+
+    bool passed = CheckWalks(base / "no-op", true);
+    passed = CheckWalks(base / "rename", false) && passed;
+
+    auto ec = std::error_code();
+    std::filesystem::remove_all(base, ec);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "helpers.h"
+#include "overrides.h"
+
+using namespace AsciiRename;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string const &what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++s_failures;
+    }
+}
+
+// A truncated name keeps its extension, right after the hash which replaces the end of its stem
+static void CheckTruncated(std::string const &input, std::string const &expectedStart)
+{
+    auto output = std::string();
+    bool truncated = false;
+    bool converted = TryGetAsciiName(input, output, truncated);
+
+    Check(converted && truncated, "\"" + expectedStart + "...\" is truncated");
+    Check(output.size() == MaxNameLength, "\"" + output + "\" is MaxNameLength long");
+    Check(output.compare(0, expectedStart.size(), expectedStart) == 0, "\"" + output + "\" starts with \"" +
+                                                                            expectedStart + "\"");
+
+    size_t suffix = output.size() - 4 - 9;
+    Check(output.compare(output.size() - 4, 4, ".txt") == 0, "\"" + output + "\" keeps its extension");
+    Check(output[suffix] == '~', "\"" + output + "\" has its hash just before the extension");
+}
+
+static void TestReservedNames()
+{
+    SetSanitizeProfile(SanitizeProfile::Windows);
+
+    auto output = std::string();
+    Check(TryGetAsciiName("con.txt", output) && output == "_con.txt", "\"con.txt\" is escaped");
+    Check(TryGetAsciiName("LPT1", output) && output == "_LPT1", "\"LPT1\" is escaped");
+    Check(TryGetAsciiName("CONSOLE.txt", output) && output == "CONSOLE.txt", "\"CONSOLE.txt\" is left alone");
+
+    // Escaping moves the extension along, which truncation has to account for
+    CheckTruncated("CON." + std::string(300, 'a') + ".txt", "_CON.aaa");
+    CheckTruncated("\xc3\x84UX." + std::string(300, 'a') + ".txt", "_AUX.aaa");
+    CheckTruncated("CONSOLE." + std::string(300, 'a') + ".txt", "CONSOLE.aaa");
+
+    SetSanitizeProfile(SanitizeProfile::Posix);
+    CheckTruncated("CON." + std::string(300, 'a') + ".txt", "CON.aaa");
+}
+
+// Decomposed (NFD) text has to come out the same as its composed (NFC) form
+static void CheckSameAscii(std::string const &composed, std::string const &decomposed, std::string const &expected,
+                           std::string const &what)
+{
+    auto output = std::string();
+    Check(TryGetAscii(composed, output) && output == expected, what + " composed is \"" + expected + "\"");
+    Check(TryGetAscii(decomposed, output) && output == expected, what + " decomposed is \"" + expected + "\"");
+}
+
+static void TestDecomposed()
+{
+    // Hangul jamo compose into a syllable, which anyascii capitalizes unlike the separate jamo
+    CheckSameAscii("\xed\x95\x9c", "\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab", "Han", "L+V+T jamo");
+
+    // anyascii drops the marks either way, so overrides for the composed characters show whether they were composed
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto mapPath = std::filesystem::temp_directory_path() / ("ascii-rename-helpers-" + std::to_string(stamp) + ".map");
+    {
+        auto stream = std::ofstream(mapPath, std::ios::binary);
+        stream << "\xe1\xbb\x87=e-dot-hat\n";
+        stream << "U+0301=acute\n";
+    }
+
+    auto overrides = TransliterationOverrides();
+    auto error = std::string();
+    Check(overrides.Load(mapPath, error), "the map file loads: " + error);
+    SetTransliterationOverrides(&overrides);
+
+    CheckSameAscii("\xe1\xbb\x87", "e\xcc\xa3\xcc\x82", "e-dot-hat", "e with dot below and circumflex");
+    CheckSameAscii("\xe1\xbb\x87", "e\xcc\x82\xcc\xa3", "e-dot-hat", "e with its marks out of canonical order");
+    CheckSameAscii("x\xe1\xbb\x87y", "xe\xcc\x82\xcc\xa3y", "xe-dot-haty", "stacked marks between letters");
+
+    // The acute composes into the e before it, but with nothing before it there's nothing to compose with
+    CheckSameAscii("\xc3\xa9", "e\xcc\x81", "e", "e with acute");
+    CheckSameAscii("\xcc\x81" "a", "\xcc\x81" "a", "acutea", "a mark with no starter");
+
+    SetTransliterationOverrides(nullptr);
+    auto ec = std::error_code();
+    std::filesystem::remove(mapPath, ec);
+}
+
+int main()
+{
+    TestReservedNames();
+    TestDecomposed();
+
+    if (s_failures > 0)
+    {
+        std::cerr << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}
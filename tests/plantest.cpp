@@ -0,0 +1,158 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+// Plans the renames of a generated tree with --no-op and --plan-out, then loads the plan and applies it from another
+// directory, checking that only the planned files are renamed and that a directory waits for everything inside it.
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "renamer.h"
+
+using namespace AsciiRename;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string const &what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++s_failures;
+    }
+}
+
+static void WriteFile(std::filesystem::path const &path, std::string const &data)
+{
+    auto stream = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    stream << data;
+}
+
+static std::string ReadFile(std::filesystem::path const &path)
+{
+    auto stream = std::ifstream(path, std::ios::binary);
+    auto data = std::string();
+    std::getline(stream, data);
+    return data;
+}
+
+// Writes the plan for root from within its parent, so the plan's sources start out relative
+static void SavePlan(std::filesystem::path const &root, std::filesystem::path const &planPath)
+{
+    auto planPathStr = planPath.u8string();
+    auto options = RenameOptions();
+    options.NoOp = true;
+    options.Recursive = true;
+    options.PlanOutFile = planPathStr.c_str();
+
+    auto previous = std::filesystem::current_path();
+    std::filesystem::current_path(root.parent_path());
+
+    auto output = std::cout.rdbuf(nullptr);
+    auto renamer = Renamer(options);
+    renamer.AddPath(root.filename().native());
+    renamer.ProcessPaths();
+    std::cout.rdbuf(output);
+    std::cout.clear();
+    Check(renamer.SavePlan(), "the plan is saved");
+
+    std::filesystem::current_path(previous);
+}
+
+static int ApplyPlan(std::filesystem::path const &planPath, Renamer &renamer)
+{
+    auto plan = RenamePlan();
+    Check(plan.Load(planPath), "the plan is loaded");
+    renamer.ApplyPlan(plan);
+    return renamer.Renames();
+}
+
+static void TestRoundTrip(std::filesystem::path const &base)
+{
+    auto root = base / "round-trip";
+    auto directory = root / std::filesystem::u8path("d\xc3\xafr");
+    std::filesystem::create_directories(directory);
+    WriteFile(directory / std::filesystem::u8path("f\xc3\xafl\xc3\xa9.txt"), "file");
+    WriteFile(root / std::filesystem::u8path("\xc3\xb6.txt"), "o");
+    WriteFile(root / "plain.txt", "plain");
+
+    auto planPath = base / "round-trip.plan";
+    SavePlan(root, planPath);
+
+    auto plan = RenamePlan();
+    Check(plan.Load(planPath) && plan.Count() == 3, "the plan has an entry for each non-ASCII name");
+    for (uint64_t i = 0; i < plan.Count(); i++)
+    {
+        auto entry = plan.Entry(i);
+        Check(std::filesystem::u8path(entry.Source).is_absolute(), "\"" + std::string(entry.Source) + "\" is absolute");
+        Check(entry.Inode != 0, "\"" + std::string(entry.Source) + "\" has its identity recorded");
+    }
+
+    // Applied from somewhere else, where the sources as typed would mean something different
+    auto output = std::cout.rdbuf(nullptr);
+    auto renamer = Renamer(RenameOptions());
+    int renames = ApplyPlan(planPath, renamer);
+    std::cout.rdbuf(output);
+    std::cout.clear();
+
+    Check(renames == 3 && renamer.Errors() == 0, "every planned rename is made");
+    Check(ReadFile(root / "dir" / "file.txt") == "file", "the directory and the file in it are renamed");
+    Check(ReadFile(root / "o.txt") == "o", "the file is renamed");
+    Check(ReadFile(root / "plain.txt") == "plain", "the ASCII file is left alone");
+}
+
+static void TestChangedSinceSaved(std::filesystem::path const &base)
+{
+    auto root = base / "changed";
+    auto directory = root / std::filesystem::u8path("d\xc3\xafr");
+    std::filesystem::create_directories(directory);
+    WriteFile(directory / std::filesystem::u8path("f\xc3\xafl\xc3\xa9.txt"), "file");
+    WriteFile(root / std::filesystem::u8path("\xc3\xbc.txt"), "planned");
+
+    auto planPath = base / "changed.plan";
+    SavePlan(root, planPath);
+
+    // The planned file is swapped for another with its name, and the planned file in the directory can't be renamed
+    WriteFile(root / "swap", "unplanned");
+    std::filesystem::rename(root / "swap", root / std::filesystem::u8path("\xc3\xbc.txt"));
+    WriteFile(directory / "file.txt", "in the way");
+
+    auto output = std::cout.rdbuf(nullptr);
+    auto errors = std::cerr.rdbuf(nullptr);
+    auto renamer = Renamer(RenameOptions());
+    int renames = ApplyPlan(planPath, renamer);
+    std::cout.rdbuf(output);
+    std::cerr.rdbuf(errors);
+    std::cout.clear();
+    std::cerr.clear();
+
+    Check(renames == 0 && renamer.Errors() == 3, "nothing is renamed");
+    Check(ReadFile(root / std::filesystem::u8path("\xc3\xbc.txt")) == "unplanned", "the replacement is left alone");
+    Check(std::filesystem::exists(directory / std::filesystem::u8path("f\xc3\xafl\xc3\xa9.txt")),
+          "the planned file whose new name is taken keeps its name");
+    Check(std::filesystem::exists(directory) && !std::filesystem::exists(root / "dir"),
+          "the directory keeps its name, since not everything in it was renamed");
+}
+
+int main()
+{
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto base = std::filesystem::temp_directory_path() / ("ascii-rename-plan-" + std::to_string(stamp));
+    std::filesystem::create_directories(base);
+
+    TestRoundTrip(base);
+    TestChangedSinceSaved(base);
+
+    auto ec = std::error_code();
+    std::filesystem::remove_all(base, ec);
+
+    if (s_failures > 0)
+    {
+        std::cerr << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+// Round-trips small ustar archives through the TarFilter, checking the member names it writes, that member data
+// follows its header, and that no member is left out when renaming one makes it collide with another.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tarfilter.h"
+
+using namespace AsciiRename;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string const &what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++s_failures;
+    }
+}
+
+struct TarMember
+{
+    std::string Name;
+    char Type;
+    std::string Data;
+};
+
+static void AppendMember(std::string &archive, TarMember const &member)
+{
+    char header[512] = {};
+    memcpy(header, member.Name.data(), member.Name.size());
+    snprintf(header + 100, 8, "%07o", member.Type == '5' ? 0755 : 0644);
+    snprintf(header + 108, 8, "%07o", 0);
+    snprintf(header + 116, 8, "%07o", 0);
+    snprintf(header + 124, 12, "%011o", (unsigned)member.Data.size());
+    snprintf(header + 136, 12, "%011o", 0);
+    header[156] = member.Type;
+    memcpy(header + 257, "ustar\0" "00", 8);
+
+    unsigned checksum = 0;
+    memset(header + 148, ' ', 8);
+    for (unsigned char c : header)
+    {
+        checksum += c;
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+
+    archive.append(header, sizeof(header));
+    archive += member.Data;
+    archive.append((512 - member.Data.size() % 512) % 512, '\0');
+}
+
+static std::string BuildTar(std::vector<TarMember> const &members)
+{
+    auto archive = std::string();
+    for (auto const &member : members)
+    {
+        AppendMember(archive, member);
+    }
+    archive.append(1024, '\0');
+    return archive;
+}
+
+static std::vector<TarMember> ReadTar(std::string const &archive)
+{
+    auto members = std::vector<TarMember>();
+    for (size_t offset = 0; offset + 512 <= archive.size();)
+    {
+        const char *header = archive.data() + offset;
+        if (header[0] == '\0')
+        {
+            break;
+        }
+
+        auto name = std::string(header, strnlen(header, 100));
+        auto prefix = std::string(header + 345, strnlen(header + 345, 155));
+        if (!prefix.empty())
+        {
+            name = prefix + "/" + name;
+        }
+        size_t size = std::stoul(std::string(header + 124, 11), nullptr, 8);
+        members.push_back({name, header[156], archive.substr(offset + 512, size)});
+        offset += 512 + (size + 511) / 512 * 512;
+    }
+    return members;
+}
+
+static std::vector<TarMember> Filter(std::filesystem::path const &base, std::string const &archive)
+{
+    auto inputPath = base / "in.tar";
+    auto outputPath = base / "out.tar";
+    {
+        auto stream = std::ofstream(inputPath, std::ios::binary | std::ios::trunc);
+        stream.write(archive.data(), archive.size());
+    }
+
+#ifdef _WIN32
+    int input = _wopen(inputPath.c_str(), _O_RDONLY | _O_BINARY);
+    int output = _wopen(outputPath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    int input = open(inputPath.c_str(), O_RDONLY);
+    int output = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+    // Collisions are reported on stderr, which only gets in the way here
+    auto errors = std::cerr.rdbuf(nullptr);
+    auto filter = TarFilter(RenameOptions(), input, output);
+    bool filtered = filter.Run();
+    std::cerr.rdbuf(errors);
+    std::cerr.clear();
+
+#ifdef _WIN32
+    _close(input);
+    _close(output);
+#else
+    close(input);
+    close(output);
+#endif
+
+    Check(filtered, "the archive is filtered");
+    Check(filter.Skipped() == 0, "no member is skipped");
+
+    auto stream = std::ifstream(outputPath, std::ios::binary);
+    return ReadTar(std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()));
+}
+
+static bool HasMember(std::vector<TarMember> const &members, std::string const &name, std::string const &data)
+{
+    for (auto const &member : members)
+    {
+        if (member.Name == name && member.Data == data)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void TestRenames(std::filesystem::path const &base)
+{
+    auto members = Filter(base, BuildTar({{"d\xc3\xafr/", '5', ""},
+                                          {"d\xc3\xafr/f\xc3\xafl\xc3\xa9.txt", '0', "caf\xc3\xa9\n"},
+                                          {"plain.txt", '0', "plain\n"}}));
+
+    Check(members.size() == 3, "all three members are written");
+    Check(HasMember(members, "dir/", ""), "the directory is renamed");
+    Check(HasMember(members, "dir/file.txt", "caf\xc3\xa9\n"), "the file is renamed along with its directory");
+    Check(HasMember(members, "plain.txt", "plain\n"), "the ASCII member is left alone");
+}
+
+static void TestLaterMemberWithNewName(std::filesystem::path const &base)
+{
+    // By the time "e.txt" arrives, "\xc3\xa9.txt" has already been written as "e.txt"
+    auto members = Filter(base, BuildTar({{"\xc3\xa9.txt", '0', "renamed\n"},
+                                          {"e.txt", '0', "untouched\n"},
+                                          {"d\xc3\xafr/", '5', ""},
+                                          {"d\xc3\xafr/a.txt", '0', "a\n"},
+                                          {"dir/", '5', ""},
+                                          {"dir/b.txt", '0', "b\n"}}));
+
+    Check(members.size() == 6, "no member is left out");
+    Check(HasMember(members, "e.txt", "renamed\n"), "the first member gets the new name");
+    Check(members.size() > 1 && members[1].Name.compare(0, 2, "e~") == 0 &&
+              members[1].Name.compare(members[1].Name.size() - 4, 4, ".txt") == 0 && members[1].Data == "untouched\n",
+          "the later member gets a hash before its extension instead of being left out");
+    Check(HasMember(members, "dir/a.txt", "a\n"), "the renamed directory keeps its member");
+
+    auto directory = members.size() > 4 ? members[4].Name : std::string();
+    Check(directory.compare(0, 4, "dir~") == 0 && directory.back() == '/',
+          "the later directory gets a hash instead of being left out");
+    Check(HasMember(members, directory + "b.txt", "b\n"), "the later directory's member follows it");
+}
+
+int main()
+{
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto base = std::filesystem::temp_directory_path() / ("ascii-rename-tar-" + std::to_string(stamp));
+    std::filesystem::create_directories(base);
+
+    TestRenames(base);
+    TestLaterMemberWithNewName(base);
+
+    auto ec = std::error_code();
+    std::filesystem::remove_all(base, ec);
+
+    if (s_failures > 0)
+    {
+        std::cerr << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+// Runs text through the TextFilter with decomposed characters straddling the boundary between chunks, checking they
+// come out the same as when they're composed, whether the input is read from a descriptor or mapped.
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "helpers.h"
+#include "overrides.h"
+#include "textfilter.h"
+
+using namespace AsciiRename;
+
+// The size the filter splits its input into, where no newline is nearby
+static const size_t ChunkSize = 1024 * 1024;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string const &what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++s_failures;
+    }
+}
+
+static void WriteFile(std::filesystem::path const &path, std::string const &data)
+{
+    auto stream = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    stream.write(data.data(), data.size());
+}
+
+static std::string ReadFile(std::filesystem::path const &path)
+{
+    auto stream = std::ifstream(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static int OpenFile(std::filesystem::path const &path, bool write)
+{
+#ifdef _WIN32
+    return write ? _wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644)
+                 : _wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    return write ? open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path.c_str(), O_RDONLY);
+#endif
+}
+
+static void CloseFile(int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+// Filters text with the character starting at splitAt, so its later code points fall in the next chunk
+static void CheckSplit(std::filesystem::path const &base, size_t splitAt, std::string const &decomposed,
+                       std::string const &expected, std::string const &what)
+{
+    auto input = std::string(splitAt, 'x') + decomposed + "\n";
+    auto inputPath = base / "input.txt";
+    auto outputPath = base / "output.txt";
+    WriteFile(inputPath, input);
+
+    auto options = RenameOptions();
+    for (bool mapped : {false, true})
+    {
+        int output = OpenFile(outputPath, true);
+        auto filter = TextFilter(options, output);
+        bool filtered = false;
+        if (mapped)
+        {
+            filtered = filter.Run(inputPath);
+        }
+        else
+        {
+            int fd = OpenFile(inputPath, false);
+            filtered = filter.Run(fd);
+            CloseFile(fd);
+        }
+        CloseFile(output);
+
+        auto result = ReadFile(outputPath);
+        auto how = std::string(mapped ? " (mapped)" : " (read)");
+        Check(filtered, what + " is filtered" + how);
+        Check(result.size() == splitAt + expected.size() + 1 && result.compare(splitAt, expected.size(), expected) == 0,
+              what + " comes out as \"" + expected + "\"" + how);
+    }
+}
+
+int main()
+{
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto base = std::filesystem::temp_directory_path() / ("ascii-rename-text-" + std::to_string(stamp));
+    std::filesystem::create_directories(base);
+
+    // Jamo compose into a syllable, which anyascii capitalizes unlike the separate jamo
+    auto jamo = std::string("\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab");
+    CheckSplit(base, ChunkSize - 1, jamo, "Han", "L+V+T jamo split after the first byte");
+    CheckSplit(base, ChunkSize - 3, jamo, "Han", "L+V+T jamo split after the leading consonant");
+    CheckSplit(base, ChunkSize - 6, jamo, "Han", "L+V+T jamo split before the trailing consonant");
+
+    // anyascii drops the marks either way, so an override for the composed character shows whether it was composed
+    auto mapPath = base / "overrides.map";
+    WriteFile(mapPath, "\xe1\xbb\x87=e-dot-hat\n");
+    auto overrides = TransliterationOverrides();
+    auto error = std::string();
+    Check(overrides.Load(mapPath, error), "the map file loads: " + error);
+    SetTransliterationOverrides(&overrides);
+
+    auto stacked = std::string("e\xcc\xa3\xcc\x82");
+    CheckSplit(base, ChunkSize - 1, stacked, "e-dot-hat", "stacked marks split before the first mark");
+    CheckSplit(base, ChunkSize - 2, stacked, "e-dot-hat", "stacked marks split inside the first mark");
+    CheckSplit(base, ChunkSize - 3, stacked, "e-dot-hat", "stacked marks split between the marks");
+    CheckSplit(base, ChunkSize - 3, "e\xcc\x82\xcc\xa3", "e-dot-hat", "out of order marks split between them");
+
+    SetTransliterationOverrides(nullptr);
+
+    auto ec = std::error_code();
+    std::filesystem::remove_all(base, ec);
+
+    if (s_failures > 0)
+    {
+        std::cerr << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+// Copyright (c) Jon Thysell <http://jonthysell.com>
+// Licensed under the MIT License.
+
+// Rewrites a small stored ZIP archive, checking the new names in both the local headers and the central directory,
+// that the entry data is untouched, and that nothing else beside the archive is overwritten or left behind.
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "ziprewriter.h"
+
+using namespace AsciiRename;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string const &what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++s_failures;
+    }
+}
+
+static void AppendUInt16(std::string &output, uint16_t value)
+{
+    output.push_back((char)(value & 0xff));
+    output.push_back((char)(value >> 8));
+}
+
+static void AppendUInt32(std::string &output, uint32_t value)
+{
+    AppendUInt16(output, (uint16_t)(value & 0xffff));
+    AppendUInt16(output, (uint16_t)(value >> 16));
+}
+
+static uint16_t ReadUInt16(std::string const &data, size_t offset)
+{
+    return (uint16_t)((unsigned char)data[offset] | ((unsigned char)data[offset + 1] << 8));
+}
+
+static uint32_t ReadUInt32(std::string const &data, size_t offset)
+{
+    return ReadUInt16(data, offset) | ((uint32_t)ReadUInt16(data, offset + 2) << 16);
+}
+
+static uint32_t Crc32(std::string const &data)
+{
+    uint32_t crc = 0xffffffff;
+    for (unsigned char c : data)
+    {
+        crc ^= c;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+struct ZipEntry
+{
+    std::string Name;
+    std::string Data;
+};
+
+// Entries are stored uncompressed and flagged as having UTF-8 names
+static std::string BuildZip(std::vector<ZipEntry> const &entries)
+{
+    auto archive = std::string();
+    auto directory = std::string();
+    for (auto const &entry : entries)
+    {
+        uint32_t offset = (uint32_t)archive.size();
+        uint32_t crc = Crc32(entry.Data);
+
+        AppendUInt32(archive, 0x04034b50);
+        AppendUInt16(archive, 10);
+        AppendUInt16(archive, 0x0800);
+        AppendUInt16(archive, 0);
+        AppendUInt32(archive, 0);
+        AppendUInt32(archive, crc);
+        AppendUInt32(archive, (uint32_t)entry.Data.size());
+        AppendUInt32(archive, (uint32_t)entry.Data.size());
+        AppendUInt16(archive, (uint16_t)entry.Name.size());
+        AppendUInt16(archive, 0);
+        archive += entry.Name;
+        archive += entry.Data;
+
+        AppendUInt32(directory, 0x02014b50);
+        AppendUInt16(directory, 20);
+        AppendUInt16(directory, 10);
+        AppendUInt16(directory, 0x0800);
+        AppendUInt16(directory, 0);
+        AppendUInt32(directory, 0);
+        AppendUInt32(directory, crc);
+        AppendUInt32(directory, (uint32_t)entry.Data.size());
+        AppendUInt32(directory, (uint32_t)entry.Data.size());
+        AppendUInt16(directory, (uint16_t)entry.Name.size());
+        AppendUInt16(directory, 0);
+        AppendUInt16(directory, 0);
+        AppendUInt16(directory, 0);
+        AppendUInt16(directory, 0);
+        AppendUInt32(directory, 0);
+        AppendUInt32(directory, offset);
+        directory += entry.Name;
+    }
+
+    uint32_t directoryOffset = (uint32_t)archive.size();
+    archive += directory;
+    AppendUInt32(archive, 0x06054b50);
+    AppendUInt16(archive, 0);
+    AppendUInt16(archive, 0);
+    AppendUInt16(archive, (uint16_t)entries.size());
+    AppendUInt16(archive, (uint16_t)entries.size());
+    AppendUInt32(archive, (uint32_t)directory.size());
+    AppendUInt32(archive, directoryOffset);
+    AppendUInt16(archive, 0);
+    return archive;
+}
+
+// Reads the entries back through the central directory, checking each local header agrees with it
+static std::vector<ZipEntry> ReadZip(std::string const &archive)
+{
+    auto entries = std::vector<ZipEntry>();
+    size_t end = archive.size() - 22;
+    if (archive.size() < 22 || ReadUInt32(archive, end) != 0x06054b50)
+    {
+        Check(false, "the rewritten archive has an end record");
+        return entries;
+    }
+
+    size_t offset = ReadUInt32(archive, end + 16);
+    for (uint16_t i = 0, count = ReadUInt16(archive, end + 10); i < count; ++i)
+    {
+        Check(ReadUInt32(archive, offset) == 0x02014b50, "central header " + std::to_string(i) + " has its signature");
+        uint32_t dataSize = ReadUInt32(archive, offset + 20);
+        uint16_t nameLength = ReadUInt16(archive, offset + 28);
+        size_t next = offset + 46 + nameLength + ReadUInt16(archive, offset + 30) + ReadUInt16(archive, offset + 32);
+        auto name = archive.substr(offset + 46, nameLength);
+
+        size_t local = ReadUInt32(archive, offset + 42);
+        uint16_t localNameLength = ReadUInt16(archive, local + 26);
+        Check(ReadUInt32(archive, local) == 0x04034b50, "\"" + name + "\" has a local header where it's listed");
+        Check(archive.compare(local + 30, localNameLength, name) == 0, "\"" + name + "\" has the same local name");
+
+        size_t dataStart = local + 30 + localNameLength + ReadUInt16(archive, local + 28);
+        entries.push_back({name, archive.substr(dataStart, dataSize)});
+        offset = next;
+    }
+    return entries;
+}
+
+static std::string ReadFile(std::filesystem::path const &path)
+{
+    auto stream = std::ifstream(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(std::filesystem::path const &path, std::string const &data)
+{
+    auto stream = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    stream.write(data.data(), data.size());
+}
+
+static void TestRewriteInPlace(std::filesystem::path const &base)
+{
+    auto archivePath = base / "archive.zip";
+    WriteFile(archivePath, BuildZip({{"d\xc3\xafr/", ""},
+                                     {"d\xc3\xafr/f\xc3\xafl\xc3\xa9.txt", "caf\xc3\xa9\n"},
+                                     {"plain.txt", "plain\n"}}));
+
+    // A file of the user's, with the name the temporary file used to have
+    auto userTemp = base / "archive.zip.tmp";
+    WriteFile(userTemp, "not ours");
+
+    auto rewriter = ZipRewriter(RenameOptions());
+    auto output = std::cout.rdbuf(nullptr);
+    bool rewritten = rewriter.Rewrite(archivePath, std::filesystem::path());
+    std::cout.rdbuf(output);
+    std::cout.clear();
+
+    Check(rewritten, "the archive is rewritten");
+    Check(rewriter.Renames() == 2 && rewriter.Skipped() == 0, "both non-ASCII entries are renamed");
+
+    auto entries = ReadZip(ReadFile(archivePath));
+    Check(entries.size() == 3, "the rewritten archive keeps all three entries");
+    if (entries.size() == 3)
+    {
+        Check(entries[0].Name == "dir/", "the directory is renamed");
+        Check(entries[1].Name == "dir/file.txt", "the file is renamed along with its directory");
+        Check(entries[1].Data == "caf\xc3\xa9\n", "the file's data is copied as it was");
+        Check(entries[2].Name == "plain.txt" && entries[2].Data == "plain\n", "the ASCII entry is left alone");
+    }
+
+    Check(ReadFile(userTemp) == "not ours", "an existing \"archive.zip.tmp\" is left alone");
+
+    size_t files = 0;
+    for (auto const &item : std::filesystem::directory_iterator(base))
+    {
+        (void)item;
+        ++files;
+    }
+    Check(files == 2, "no temporary file is left behind");
+}
+
+static void TestRewriteToOutput(std::filesystem::path const &base)
+{
+    auto archivePath = base / "input.zip";
+    auto outputPath = base / "output.zip";
+    auto original = BuildZip({{"\xc3\xa9t\xc3\xa9.txt", "summer\n"}});
+    WriteFile(archivePath, original);
+
+    auto options = RenameOptions();
+    options.NoOp = true;
+    auto output = std::cout.rdbuf(nullptr);
+    auto noOp = ZipRewriter(options);
+    noOp.Rewrite(archivePath, outputPath);
+    auto rewriter = ZipRewriter(RenameOptions());
+    bool rewritten = rewriter.Rewrite(archivePath, outputPath);
+    std::cout.rdbuf(output);
+    std::cout.clear();
+
+    Check(noOp.Renames() == 1, "--no-op counts the rename");
+    Check(rewritten, "the archive is rewritten to the output");
+    Check(ReadFile(archivePath) == original, "the input is left alone when writing to an output");
+
+    auto entries = ReadZip(ReadFile(outputPath));
+    Check(entries.size() == 1 && entries[0].Name == "ete.txt" && entries[0].Data == "summer\n",
+          "the output has the renamed entry");
+}
+
+int main()
+{
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto base = std::filesystem::temp_directory_path() / ("ascii-rename-zip-" + std::to_string(stamp));
+    std::filesystem::create_directories(base / "in-place");
+    std::filesystem::create_directories(base / "output");
+
+    TestRewriteInPlace(base / "in-place");
+    TestRewriteToOutput(base / "output");
+
+    auto ec = std::error_code();
+    std::filesystem::remove_all(base, ec);
+
+    if (s_failures > 0)
+    {
+        std::cerr << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}